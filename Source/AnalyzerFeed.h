@@ -0,0 +1,242 @@
+#pragma once
+
+#include "JuceHeader.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+// Carries the output of the synth to the spectrum analyzer without the audio
+// thread ever touching editor memory or waiting for another thread.
+//
+// The processor owns the feed. The audio thread copies each block into a
+// single-producer single-consumer ring (juce::AbstractFifo), and does nothing
+// else. A background thread, running only while an analyzer is showing, moves
+// the samples into a history buffer and runs an overlapped STFT over it: a
+// frame of fftSize samples every hop samples, where the FFT size (512 to
+// 16384) and the overlap (0 to 87.5%) can be changed at any time. The FFT
+// plans and windows for every size are made up front, so a change never
+// allocates.
+//
+// Frames are combined by taking the peak of every bin, and the result is
+// published through a triple buffer at most every PUBLISHINTERVALMS, so a
+// transient between two repaints still shows. The message thread picks up
+// the newest spectrum with readSpectrum(), never blocking the analysis thread
+// and never seeing a half-written spectrum. If the analysis thread falls
+// behind, it skips ahead to the newest audio, so the work per second stays
+// bounded and nothing queues up.
+class AnalyzerFeed : private juce::Thread
+{
+public:
+    static constexpr int MINORDER = 9, MAXORDER = 14;  // 512 to 16384 points
+    static constexpr int MAXOVERLAP = 3;               // hop = fftSize >> overlap, so 0, 50, 75 or 87.5%
+    static constexpr int MAXSIZE = 1 << MAXORDER;
+    static constexpr int MAXBINS = MAXSIZE / 2;
+
+    AnalyzerFeed()
+        : juce::Thread("DX10 analyzer"),
+          fifo(ringSize)
+    {
+        for (int order = MINORDER; order <= MAXORDER; ++order)
+        {
+            ffts[size_t(order - MINORDER)] = std::make_unique<juce::dsp::FFT>(order);
+            windows[size_t(order - MINORDER)] = std::make_unique<juce::dsp::WindowingFunction<float>>(size_t(1 << order), juce::dsp::WindowingFunction<float>::hann);
+        }
+        ring.resize(size_t(ringSize));
+        history.resize(size_t(MAXSIZE), 0.0f);
+        frame.resize(size_t(MAXSIZE * 2));
+        for (auto& spectrum : spectra) spectrum.assign(size_t(MAXBINS), 0.0f);
+    }
+
+    ~AnalyzerFeed() override
+    {
+        stop();
+    }
+
+    // Starts or stops the analysis. Call from the message thread, e.g. when
+    // the editor opens and closes. While stopped, push() returns at once.
+    void start()
+    {
+        if (isThreadRunning()) return;
+        active.store(true, std::memory_order_release);
+        startThread(juce::Thread::Priority::low);
+    }
+
+    void stop()
+    {
+        active.store(false, std::memory_order_release);
+        stopThread(1000);
+    }
+
+    // FFT size as a power of two, MINORDER to MAXORDER, and overlap as
+    // 0 to MAXOVERLAP. Any thread; the analysis picks them up at the next frame.
+    void setFftOrder(int order) { fftOrder.store(juce::jlimit(MINORDER, MAXORDER, order)); }
+    int getFftOrder() const { return fftOrder.load(); }
+    void setOverlap(int overlap) { overlapIndex.store(juce::jlimit(0, MAXOVERLAP, overlap)); }
+    int getOverlap() const { return overlapIndex.load(); }
+
+    // Called by the audio thread with the mono output. If the analysis thread
+    // has fallen so far behind that the ring is full, the samples that don't
+    // fit are dropped.
+    void push(const float* data, int numSamples) noexcept
+    {
+        if (!active.load(std::memory_order_acquire)) return;
+
+        const auto scope = fifo.write(juce::jmin(numSamples, fifo.getFreeSpace()));
+        if (scope.blockSize1 > 0) std::copy(data, data + scope.blockSize1, ring.data() + scope.startIndex1);
+        if (scope.blockSize2 > 0) std::copy(data + scope.blockSize1, data + scope.blockSize1 + scope.blockSize2, ring.data() + scope.startIndex2);
+    }
+
+    // Copies the newest spectrum into dest, which must hold MAXBINS values,
+    // as linear magnitudes divided by the FFT size, so the level of a sine
+    // doesn't depend on the FFT size. numBins is set to the number of bins
+    // (half the FFT size). Returns false if no new spectrum has been
+    // published since the previous call. Message thread only.
+    bool readSpectrum(std::vector<float>& dest, int& numBins)
+    {
+        if ((published.load(std::memory_order_relaxed) & newFlag) == 0) return false;
+
+        // Swap the front buffer with the newest one the analysis thread left
+        front = published.exchange(front, std::memory_order_acq_rel) & indexMask;
+        numBins = spectrumBins[size_t(front)];
+        std::copy(spectra[size_t(front)].begin(), spectra[size_t(front)].begin() + numBins, dest.begin());
+        return true;
+    }
+
+private:
+    static constexpr int ringSize = MAXSIZE * 2;
+    static constexpr int newFlag = 4, indexMask = 3;
+    static constexpr juce::uint32 PUBLISHINTERVALMS = 15;
+
+    void run() override
+    {
+        while (!threadShouldExit())
+        {
+            int ready = fifo.getNumReady();
+            if (ready == 0)
+            {
+                publishIfDue();
+                wait(5);
+                continue;
+            }
+
+            // Pick up new settings
+            const int order = fftOrder.load();
+            const int hop = (1 << order) >> overlapIndex.load();
+            if (order != activeOrder || hop != activeHop)
+            {
+                activeOrder = order;
+                activeHop = hop;
+                samplesSinceFrame = 0;
+                framesInBack = 0;
+            }
+            const int size = 1 << activeOrder;
+
+            // Far behind: keep only the newest frame's worth of audio
+            if (ready > juce::jmax(size + activeHop, ringSize / 2))
+            {
+                readIntoHistory(ready - size);
+                ready = size;
+                samplesSinceFrame = 0;
+            }
+
+            // Read up to the next frame, then analyse it
+            const int numToRead = juce::jmin(ready, activeHop - samplesSinceFrame);
+            readIntoHistory(numToRead);
+            samplesSinceFrame += numToRead;
+            if (samplesSinceFrame == activeHop)
+            {
+                samplesSinceFrame = 0;
+                if (historyCount >= size) analyseFrame();
+            }
+            publishIfDue();
+        }
+    }
+
+    void readIntoHistory(int numSamples)
+    {
+        while (numSamples > 0)
+        {
+            const auto scope = fifo.read(juce::jmin(numSamples, MAXSIZE - historyPos));
+            const int numRead = scope.blockSize1 + scope.blockSize2;
+            std::copy(ring.data() + scope.startIndex1, ring.data() + scope.startIndex1 + scope.blockSize1, history.data() + historyPos);
+            std::copy(ring.data() + scope.startIndex2, ring.data() + scope.startIndex2 + scope.blockSize2, history.data() + historyPos + scope.blockSize1);
+            historyPos = (historyPos + numRead) & (MAXSIZE - 1);
+            historyCount = juce::jmin(MAXSIZE, historyCount + numRead);
+            numSamples -= numRead;
+            if (numRead == 0) break;
+        }
+    }
+
+    // Transforms the newest fftSize samples of the history and merges the
+    // magnitudes into the spectrum that will be published next.
+    void analyseFrame()
+    {
+        const int size = 1 << activeOrder;
+        const int numBins = size / 2;
+
+        // Unwrap the newest size samples from the history
+        const int start = (historyPos - size) & (MAXSIZE - 1);
+        const int firstPart = juce::jmin(size, MAXSIZE - start);
+        std::copy(history.data() + start, history.data() + start + firstPart, frame.data());
+        std::copy(history.data(), history.data() + (size - firstPart), frame.data() + firstPart);
+
+        windows[size_t(activeOrder - MINORDER)]->multiplyWithWindowingTable(frame.data(), size_t(size));
+        ffts[size_t(activeOrder - MINORDER)]->performFrequencyOnlyForwardTransform(frame.data(), true);
+
+        auto& spectrum = spectra[size_t(back)];
+        if (framesInBack == 0 || spectrumBins[size_t(back)] != numBins)
+        {
+            juce::FloatVectorOperations::multiply(spectrum.data(), frame.data(), 1.0f / float(size), numBins);
+            spectrumBins[size_t(back)] = numBins;
+            framesInBack = 0;
+        }
+        else
+        {
+            juce::FloatVectorOperations::multiply(frame.data(), 1.0f / float(size), numBins);
+            juce::FloatVectorOperations::max(spectrum.data(), spectrum.data(), frame.data(), numBins);
+        }
+        ++framesInBack;
+    }
+
+    void publishIfDue()
+    {
+        const auto now = juce::Time::getMillisecondCounter();
+        if (framesInBack == 0 || now - lastPublishTime < PUBLISHINTERVALMS) return;
+
+        // Hand the finished spectrum over and take the one it replaces
+        back = published.exchange(back | newFlag, std::memory_order_acq_rel) & indexMask;
+        framesInBack = 0;
+        lastPublishTime = now;
+    }
+
+    // One FFT plan and window per size
+    std::array<std::unique_ptr<juce::dsp::FFT>, MAXORDER - MINORDER + 1> ffts;
+    std::array<std::unique_ptr<juce::dsp::WindowingFunction<float>>, MAXORDER - MINORDER + 1> windows;
+
+    // Settings, written by any thread
+    std::atomic<int> fftOrder { 11 }, overlapIndex { 1 };
+
+    // Samples from the audio thread
+    juce::AbstractFifo fifo;
+    std::vector<float> ring;
+    std::atomic<bool> active { false };
+
+    // Analysis thread: the newest MAXSIZE samples and the settings in use
+    std::vector<float> history, frame;
+    int historyPos = 0, historyCount = 0;
+    int activeOrder = -1, activeHop = 0, samplesSinceFrame = 0;
+    int framesInBack = 0;
+    juce::uint32 lastPublishTime = 0;
+
+    // Triple buffer: the analysis thread writes spectra[back], the message
+    // thread reads spectra[front], and published holds the index of the
+    // third one, plus newFlag when it holds a spectrum the reader hasn't seen.
+    std::array<std::vector<float>, 3> spectra;
+    std::array<int, 3> spectrumBins { { 0, 0, 0 } };
+    int back = 0, front = 1;
+    std::atomic<int> published { 2 };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(AnalyzerFeed)
+};
@@ -0,0 +1,195 @@
+#pragma once
+
+#include "JuceHeader.h"
+#include <atomic>
+#include <cmath>
+
+// Always-on statistics about every processed block: how long it took, how
+// many voices were sounding, how many MIDI events it had and how many samples
+// it was. The audio thread adds to preallocated histograms and writes a ring
+// of the most recent blocks, using relaxed atomic stores only, so recording
+// costs a handful of instructions and never blocks or allocates. The message
+// thread can read everything at any time and write it out as JSON (the
+// histograms, with percentiles of the block time) or CSV (the recent blocks).
+//
+// Block times go into logarithmic buckets, BUCKETSPEROCTAVE per doubling
+// from 256 ns up, so percentiles are accurate to about 9%.
+class BlockTelemetry
+{
+public:
+    static const int RINGSIZE = 8192;  // recent blocks kept, a power of two
+    static const int MAXVOICES = 255;
+    static const int MAXEVENTS = 255;
+
+    BlockTelemetry() = default;
+
+    // Call from the audio thread at the end of every block.
+    void record(double seconds, int numSamples, int numVoices, int numEvents) noexcept
+    {
+        const auto ns = uint32_t(juce::jlimit(0.0, 4.0e9, seconds * 1.0e9));
+        numSamples = juce::jlimit(0, 65535, numSamples);
+        numVoices = juce::jlimit(0, MAXVOICES, numVoices);
+        numEvents = juce::jlimit(0, MAXEVENTS, numEvents);
+
+        increment(durationBuckets[getDurationBucket(ns)]);
+        increment(voiceBuckets[numVoices]);
+        increment(eventBuckets[numEvents]);
+        increment(blockSizeBuckets[getBlockSizeBucket(numSamples)]);
+        if (ns > maxDurationNs.load(std::memory_order_relaxed)) maxDurationNs.store(ns, std::memory_order_relaxed);
+        totalSamples.store(totalSamples.load(std::memory_order_relaxed) + uint64_t(numSamples), std::memory_order_relaxed);
+
+        // Each ring entry is one 64-bit word, so a reader never sees half of it
+        const uint64_t entry = uint64_t(ns) << 32 | uint64_t(numSamples) << 16 | uint64_t(numVoices) << 8 | uint64_t(numEvents);
+        const uint64_t index = numBlocks.load(std::memory_order_relaxed);
+        ring[index & (RINGSIZE - 1)].store(entry, std::memory_order_relaxed);
+        numBlocks.store(index + 1, std::memory_order_release);
+    }
+
+    // Call from the audio thread when the sample rate changes, so the JSON
+    // can express block times relative to the time each block lasts.
+    void setSampleRate(double newSampleRate) noexcept { sampleRate.store(newSampleRate, std::memory_order_relaxed); }
+
+    uint64_t getNumBlocks() const { return numBlocks.load(std::memory_order_acquire); }
+
+    // The histograms, with percentiles of the block time.
+    juce::var toJson() const
+    {
+        const uint64_t blocks = getNumBlocks();
+        const double rate = sampleRate.load(std::memory_order_relaxed);
+
+        auto* durations = new juce::DynamicObject();
+        durations->setProperty("bucketsPerOctave", BUCKETSPEROCTAVE);
+        durations->setProperty("firstBucketNs", double(MINDURATIONNS));
+        durations->setProperty("counts", toArray(durationBuckets, NUMDURATIONBUCKETS));
+
+        auto* percentiles = new juce::DynamicObject();
+        percentiles->setProperty("p50", getDurationPercentileNs(0.5));
+        percentiles->setProperty("p90", getDurationPercentileNs(0.9));
+        percentiles->setProperty("p99", getDurationPercentileNs(0.99));
+        percentiles->setProperty("p999", getDurationPercentileNs(0.999));
+        percentiles->setProperty("max", double(maxDurationNs.load(std::memory_order_relaxed)));
+
+        juce::Array<juce::var> blockSizes;
+        for (int i = 0; i < NUMBLOCKSIZEBUCKETS; ++i)
+        {
+            const auto count = blockSizeBuckets[i].load(std::memory_order_relaxed);
+            if (count == 0) continue;
+            auto* bucket = new juce::DynamicObject();
+            bucket->setProperty("upTo", 1 << i);
+            bucket->setProperty("count", double(count));
+            blockSizes.add(juce::var(bucket));
+        }
+
+        auto* root = new juce::DynamicObject();
+        root->setProperty("sampleRate", rate);
+        root->setProperty("blocks", double(blocks));
+        root->setProperty("seconds", rate > 0.0 ? double(totalSamples.load(std::memory_order_relaxed)) / rate : 0.0);
+        root->setProperty("blockTimeNs", juce::var(percentiles));
+        root->setProperty("blockTimeHistogram", juce::var(durations));
+        root->setProperty("voiceHistogram", toArray(voiceBuckets, MAXVOICES + 1));
+        root->setProperty("eventHistogram", toArray(eventBuckets, MAXEVENTS + 1));
+        root->setProperty("blockSizeHistogram", blockSizes);
+        return juce::var(root);
+    }
+
+    // The most recent blocks, oldest first, one per line.
+    juce::String toCsv() const
+    {
+        const uint64_t end = getNumBlocks();
+        const uint64_t start = end > uint64_t(RINGSIZE) ? end - uint64_t(RINGSIZE) : 0;
+        const double rate = sampleRate.load(std::memory_order_relaxed);
+
+        juce::MemoryOutputStream csv;
+        csv << "block,durationNs,blockSize,load,voices,events\n";
+        for (uint64_t i = start; i < end; ++i)
+        {
+            const uint64_t entry = ring[i & (RINGSIZE - 1)].load(std::memory_order_relaxed);
+            const auto ns = uint32_t(entry >> 32);
+            const int numSamples = int((entry >> 16) & 0xffff);
+            const double load = numSamples > 0 && rate > 0.0 ? ns * 1.0e-9 * rate / numSamples : 0.0;
+            csv << juce::String(juce::int64(i)) << "," << juce::String(ns) << "," << numSamples << "," << juce::String(load, 4)
+                << "," << int((entry >> 8) & 0xff) << "," << int(entry & 0xff) << "\n";
+        }
+        return csv.toString();
+    }
+
+    // Writes CSV if the file ends in .csv, JSON otherwise.
+    bool writeToFile(const juce::File& file) const
+    {
+        file.getParentDirectory().createDirectory();
+        return file.replaceWithText(file.hasFileExtension("csv") ? toCsv() : juce::JSON::toString(toJson()));
+    }
+
+    // Block time (upper edge of its bucket) that the given proportion of
+    // blocks stayed within.
+    double getDurationPercentileNs(double proportion) const
+    {
+        uint64_t total = 0;
+        for (const auto& bucket : durationBuckets) total += bucket.load(std::memory_order_relaxed);
+        if (total == 0) return 0.0;
+
+        const auto target = uint64_t(std::ceil(proportion * double(total)));
+        uint64_t sum = 0;
+        for (int i = 0; i < NUMDURATIONBUCKETS; ++i)
+        {
+            sum += durationBuckets[i].load(std::memory_order_relaxed);
+            if (sum >= target) return getBucketUpperNs(i);
+        }
+        return double(maxDurationNs.load(std::memory_order_relaxed));
+    }
+
+private:
+    static const int BUCKETSPEROCTAVE = 8;
+    static const uint32_t MINDURATIONNS = 256;
+    static const int NUMDURATIONBUCKETS = 24 * BUCKETSPEROCTAVE + 1;  // up to about 4 seconds
+    static const int NUMBLOCKSIZEBUCKETS = 17;
+
+    static int getDurationBucket(uint32_t ns) noexcept
+    {
+        if (ns < MINDURATIONNS) return 0;
+        const int bucket = 1 + int(std::log2(double(ns) / MINDURATIONNS) * BUCKETSPEROCTAVE);
+        return juce::jmin(bucket, NUMDURATIONBUCKETS - 1);
+    }
+
+    static double getBucketUpperNs(int bucket) noexcept
+    {
+        return MINDURATIONNS * std::exp2(double(bucket) / BUCKETSPEROCTAVE);
+    }
+
+    // Bucket i holds block sizes above 2^(i-1), up to 2^i.
+    static int getBlockSizeBucket(int numSamples) noexcept
+    {
+        int bucket = 0;
+        while ((1 << bucket) < numSamples) ++bucket;
+        return bucket;
+    }
+
+    // Only the audio thread writes, so a plain load and store is enough
+    template <typename T>
+    static void increment(std::atomic<T>& counter) noexcept
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    template <typename T>
+    static juce::var toArray(const std::atomic<T>* buckets, int numBuckets)
+    {
+        juce::Array<juce::var> array;
+        for (int i = 0; i < numBuckets; ++i)
+            array.add(double(buckets[i].load(std::memory_order_relaxed)));
+        return array;
+    }
+
+    std::atomic<uint32_t> durationBuckets[NUMDURATIONBUCKETS] = {};
+    std::atomic<uint32_t> voiceBuckets[MAXVOICES + 1] = {};
+    std::atomic<uint32_t> eventBuckets[MAXEVENTS + 1] = {};
+    std::atomic<uint32_t> blockSizeBuckets[NUMBLOCKSIZEBUCKETS] = {};
+    std::atomic<uint32_t> maxDurationNs { 0 };
+    std::atomic<uint64_t> totalSamples { 0 };
+    std::atomic<double> sampleRate { 0.0 };
+
+    std::atomic<uint64_t> ring[RINGSIZE] = {};
+    std::atomic<uint64_t> numBlocks { 0 };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(BlockTelemetry)
+};
@@ -1,6 +1,11 @@
 #pragma once
 
 #include "JuceHeader.h"
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <tuple>
 
 class DX10LookAndFeel : public juce::LookAndFeel_V4
 {
@@ -21,11 +26,35 @@ public:
         setColour(juce::PopupMenu::highlightedTextColourId, juce::Colour(0xFF000000));
     }
 
+    ~DX10LookAndFeel() override
+    {
+        for (auto& entry : knobStrips) entry.second->cancelled.store(true);
+        knobRenderer.removeAllJobs(true, 2000);
+    }
+
     void drawRotarySlider(juce::Graphics& g, int x, int y, int width, int height,
                           float sliderPosProportional, float rotaryStartAngle,
-                          float rotaryEndAngle, juce::Slider& slider) override
+                          float rotaryEndAngle, juce::Slider&) override
+    {
+        // Blit the nearest frame of a pre-rendered filmstrip, or draw the
+        // vectors while the filmstrip for this size is still being made
+        const float pixelScale = g.getInternalContext().getPhysicalPixelScaleFactor();
+        if (auto* strip = getKnobStrip(width, height, pixelScale, rotaryStartAngle, rotaryEndAngle))
+        {
+            const int frame = juce::jlimit(0, KNOBFRAMES - 1, juce::roundToInt(sliderPosProportional * float(KNOBFRAMES - 1)));
+            g.drawImage(strip->image, x, y, width, height,
+                        (frame % KNOBCOLUMNS) * strip->frameWidth, (frame / KNOBCOLUMNS) * strip->frameHeight,
+                        strip->frameWidth, strip->frameHeight);
+            return;
+        }
+        drawKnob(g, juce::Rectangle<int>(x, y, width, height).toFloat(), sliderPosProportional, rotaryStartAngle, rotaryEndAngle);
+    }
+
+    // The knob as vectors, filling area.
+    static void drawKnob(juce::Graphics& g, juce::Rectangle<float> area, float sliderPosProportional,
+                         float rotaryStartAngle, float rotaryEndAngle)
     {
-        auto bounds = juce::Rectangle<int>(x, y, width, height).toFloat().reduced(4.0f);
+        auto bounds = area.reduced(4.0f);
         auto radius = juce::jmin(bounds.getWidth(), bounds.getHeight()) / 2.0f;
         auto centreX = bounds.getCentreX();
         auto centreY = bounds.getCentreY();
@@ -116,8 +145,8 @@ public:
         }
     }
 
-    void drawComboBox(juce::Graphics& g, int width, int height, bool isButtonDown,
-                      int buttonX, int buttonY, int buttonW, int buttonH,
+    void drawComboBox(juce::Graphics& g, int width, int height, bool /*isButtonDown*/,
+                      int buttonX, int /*buttonY*/, int buttonW, int /*buttonH*/,
                       juce::ComboBox& box) override
     {
         auto cornerSize = 6.0f;
@@ -165,4 +194,100 @@ public:
     {
         return juce::Font(juce::FontOptions("Arial", 11.0f, juce::Font::bold));
     }
+
+private:
+    // Knob filmstrips: KNOBFRAMES positions from start to end, in a grid of
+    // KNOBCOLUMNS columns so no image gets too tall for the GPU
+    static constexpr int KNOBFRAMES = 128, KNOBCOLUMNS = 16;
+    static constexpr size_t MAXKNOBSTRIPS = 8;
+
+    struct KnobStrip
+    {
+        int width = 0, height = 0, frameWidth = 0, frameHeight = 0;
+        float pixelScale = 1.0f, startAngle = 0.0f, endAngle = 0.0f;
+        juce::Image image;
+        std::atomic<bool> ready { false }, cancelled { false };
+        bool isNative = false;
+        juce::uint32 lastUsed = 0;
+    };
+
+    // Returns the filmstrip for a knob of this size, display scale and
+    // range, or nullptr if it isn't ready yet, in which case it is queued
+    // for the renderer thread. Message thread only.
+    KnobStrip* getKnobStrip(int width, int height, float pixelScale, float startAngle, float endAngle)
+    {
+        if (width <= 0 || height <= 0) return nullptr;
+
+        const auto key = std::make_tuple(width, height, juce::roundToInt(pixelScale * 100.0f),
+                                         juce::roundToInt(startAngle * 1000.0f), juce::roundToInt(endAngle * 1000.0f));
+        auto found = knobStrips.find(key);
+        if (found == knobStrips.end())
+        {
+            // Forget the least recently used strip, e.g. a size left behind by a resize
+            if (knobStrips.size() >= MAXKNOBSTRIPS)
+            {
+                auto oldest = std::min_element(knobStrips.begin(), knobStrips.end(),
+                    [](const auto& a, const auto& b) { return a.second->lastUsed < b.second->lastUsed; });
+                oldest->second->cancelled.store(true);
+                knobStrips.erase(oldest);
+            }
+
+            auto strip = std::make_shared<KnobStrip>();
+            strip->width = width;
+            strip->height = height;
+            strip->pixelScale = pixelScale;
+            strip->startAngle = startAngle;
+            strip->endAngle = endAngle;
+            strip->frameWidth = juce::jmax(1, juce::roundToInt(float(width) * pixelScale));
+            strip->frameHeight = juce::jmax(1, juce::roundToInt(float(height) * pixelScale));
+            knobRenderer.addJob([strip] { renderKnobStrip(*strip); });
+            found = knobStrips.emplace(key, strip).first;
+        }
+
+        auto& strip = *found->second;
+        strip.lastUsed = ++knobStripClock;
+        if (!strip.ready.load(std::memory_order_acquire)) return nullptr;
+
+        // Rendered in software off the message thread; move it to the
+        // platform's image type once, so blits don't convert it every time
+        if (!strip.isNative)
+        {
+            strip.image = juce::NativeImageType().convert(strip.image);
+            strip.isNative = true;
+        }
+        return &strip;
+    }
+
+    // Runs on the renderer thread.
+    static void renderKnobStrip(KnobStrip& strip)
+    {
+        const int rows = (KNOBFRAMES + KNOBCOLUMNS - 1) / KNOBCOLUMNS;
+        juce::Image image(juce::Image::ARGB, strip.frameWidth * KNOBCOLUMNS, strip.frameHeight * rows, true, juce::SoftwareImageType());
+        {
+            juce::Graphics g(image);
+            for (int frame = 0; frame < KNOBFRAMES; ++frame)
+            {
+                if (strip.cancelled.load()) return;
+
+                const juce::Rectangle<int> cell((frame % KNOBCOLUMNS) * strip.frameWidth, (frame / KNOBCOLUMNS) * strip.frameHeight,
+                                                strip.frameWidth, strip.frameHeight);
+                juce::Graphics::ScopedSaveState state(g);
+                g.reduceClipRegion(cell);
+                g.addTransform(juce::AffineTransform::scale(float(strip.frameWidth) / float(strip.width), float(strip.frameHeight) / float(strip.height))
+                                   .translated(float(cell.getX()), float(cell.getY())));
+                drawKnob(g, { 0.0f, 0.0f, float(strip.width), float(strip.height) },
+                         float(frame) / float(KNOBFRAMES - 1), strip.startAngle, strip.endAngle);
+            }
+        }
+        strip.image = image;
+        strip.ready.store(true, std::memory_order_release);
+    }
+
+    std::map<std::tuple<int, int, int, int, int>, std::shared_ptr<KnobStrip>> knobStrips;
+    juce::uint32 knobStripClock = 0;
+
+    // Declared last, so it stops before the strips go away
+    juce::ThreadPool knobRenderer { juce::ThreadPoolOptions{}.withThreadName("DX10 knob renderer")
+                                                              .withNumberOfThreads(1)
+                                                              .withDesiredThreadPriority(juce::Thread::Priority::low) };
 };
@@ -0,0 +1,99 @@
+#pragma once
+
+#include "JuceHeader.h"
+#include "PluginProcessor.h"
+
+// Shows how much of its time budget this instance uses: the current DSP load
+// as a bar, the recent peak as a tick on the bar, the number of sounding
+// voices, and the share of blocks over the last two seconds that came close
+// to running out of time (the xrun risk). Polls the processor's lock-free
+// counters on a timer, so the audio thread never waits for the UI.
+class LoadMeter : public juce::Component,
+                  private juce::Timer
+{
+public:
+    explicit LoadMeter(DX10AudioProcessor& p)
+        : processor(p)
+    {
+        setInterceptsMouseClicks(false, false);
+        lastBlocks = processor.getNumBlocks();
+        lastBlocksOverBudget = processor.getNumBlocksOverBudget();
+        startTimerHz(timerHz);
+    }
+
+    ~LoadMeter() override
+    {
+        stopTimer();
+    }
+
+    void paint(juce::Graphics& g) override
+    {
+        auto bounds = getLocalBounds().toFloat();
+        const float fontHeight = juce::jmin(11.0f, bounds.getHeight() - 2.0f);
+        g.setFont(juce::Font(juce::FontOptions(fontHeight)));
+
+        // Bar with the current load and a tick at the peak
+        auto barBounds = bounds.removeFromLeft(bounds.getWidth() * 0.35f).reduced(0.0f, bounds.getHeight() * 0.3f);
+        g.setColour(juce::Colour(0xFF1A1A22));
+        g.fillRoundedRectangle(barBounds, 2.0f);
+        g.setColour(getLoadColour(load));
+        g.fillRoundedRectangle(barBounds.withWidth(barBounds.getWidth() * juce::jmin(1.0f, load)), 2.0f);
+        g.setColour(getLoadColour(peak));
+        g.fillRect(barBounds.getX() + barBounds.getWidth() * juce::jmin(1.0f, peak) - 1.0f, barBounds.getY(), 2.0f, barBounds.getHeight());
+
+        g.setColour(juce::Colour(0xFF888899));
+        const auto text = "DSP " + juce::String(juce::roundToInt(load * 100.0f)) + "%  PEAK " + juce::String(juce::roundToInt(peak * 100.0f))
+                        + "%  VOICES " + juce::String(voices) + "  XRUN RISK " + juce::String(juce::roundToInt(xrunRisk * 100.0f)) + "%";
+        g.drawText(text, bounds.withTrimmedLeft(6.0f), juce::Justification::centredLeft, true);
+    }
+
+private:
+    static constexpr int timerHz = 10;
+    static constexpr int riskWindow = timerHz * 2;
+
+    void timerCallback() override
+    {
+        load = processor.getDspLoad();
+        peak = juce::jmax(processor.takePeakDspLoad(), peak * 0.9f);  // hold the peak, then let it fall
+        voices = processor.getNumActiveVoices();
+
+        const uint32_t blocks = processor.getNumBlocks();
+        const uint32_t blocksOverBudget = processor.getNumBlocksOverBudget();
+        riskBlocks[riskIndex] = blocks - lastBlocks;
+        riskBlocksOverBudget[riskIndex] = blocksOverBudget - lastBlocksOverBudget;
+        riskIndex = (riskIndex + 1) % riskWindow;
+        lastBlocks = blocks;
+        lastBlocksOverBudget = blocksOverBudget;
+
+        uint32_t windowBlocks = 0, windowOverBudget = 0;
+        for (int i = 0; i < riskWindow; ++i)
+        {
+            windowBlocks += riskBlocks[i];
+            windowOverBudget += riskBlocksOverBudget[i];
+        }
+        xrunRisk = windowBlocks > 0 ? float(windowOverBudget) / float(windowBlocks) : 0.0f;
+
+        repaint();
+    }
+
+    static juce::Colour getLoadColour(float proportion)
+    {
+        if (proportion > DX10AudioProcessor::HIGHLOAD)
+            return juce::Colour(0xFFE04848);
+        if (proportion > DX10AudioProcessor::HIGHLOAD * 0.5f)
+            return juce::Colour(0xFFE0B040);
+        return juce::Colour(0xFF00D4AA);
+    }
+
+    DX10AudioProcessor& processor;
+
+    float load = 0.0f, peak = 0.0f, xrunRisk = 0.0f;
+    int voices = 0;
+
+    // Blocks rendered and blocks over budget in each of the last riskWindow timer ticks
+    uint32_t riskBlocks[riskWindow] = {}, riskBlocksOverBudget[riskWindow] = {};
+    int riskIndex = 0;
+    uint32_t lastBlocks = 0, lastBlocksOverBudget = 0;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(LoadMeter)
+};
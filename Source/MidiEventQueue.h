@@ -0,0 +1,86 @@
+#pragma once
+
+#include "JuceHeader.h"
+#include <atomic>
+#include <limits>
+#include <vector>
+
+// One MIDI event for the current block, already decoded.
+struct MidiEvent
+{
+    enum Type : uint8_t
+    {
+        NoteOn,         // data1 = note, data2 = velocity (never 0)
+        NoteOff,        // data1 = note
+        Controller,     // data1 = controller number, data2 = value
+        PitchBend,      // data1 = 14-bit bend value, 8192 is centre
+        ProgramChange,  // data1 = program number
+    };
+
+    int frame;  // sample position in the block
+    Type type;
+    int data1;
+    int data2;
+};
+
+// The MIDI events of one block in timestamp order. The storage is allocated in
+// prepare(), so adding events on the audio thread never allocates. If a block
+// has more events than fit, the extra events are dropped and counted. The last
+// few slots are kept free for events that release notes (note offs, sustain
+// pedal up, all notes off), so a full queue drops new notes rather than
+// leaving notes hanging.
+class MidiEventQueue
+{
+public:
+    // Call from prepareToPlay(). There is room for two events per sample, with
+    // a floor that covers small block sizes.
+    void prepare(int maxBlockSize)
+    {
+        events.assign(size_t(juce::jmax(MINCAPACITY, maxBlockSize * 2)), MidiEvent {});
+        numEvents = 0;
+    }
+
+    void clear() { numEvents = 0; }
+
+    // Adds an event, keeping the queue sorted by frame. Events with the same
+    // frame stay in the order they were added.
+    bool push(const MidiEvent &event)
+    {
+        const int capacity = int(events.size());
+        const int limit = releasesNotes(event) ? capacity : capacity - RELEASERESERVE;
+        if (numEvents >= limit) { overflowCount.fetch_add(1, std::memory_order_relaxed); return false; }
+
+        int i = numEvents++;
+        for (; i > 0 && events[size_t(i - 1)].frame > event.frame; --i) events[size_t(i)] = events[size_t(i - 1)];
+        events[size_t(i)] = event;
+        return true;
+    }
+
+    int size() const { return numEvents; }
+    bool isEmpty() const { return numEvents == 0; }
+    const MidiEvent &operator[](int index) const { return events[size_t(index)]; }
+
+    // Frame of event index, or INT_MAX past the last event.
+    int getFrame(int index) const { return index < numEvents ? events[size_t(index)].frame : std::numeric_limits<int>::max(); }
+
+    // Total number of events dropped because the queue was full. Safe to read
+    // from any thread.
+    uint32_t getOverflowCount() const { return overflowCount.load(std::memory_order_relaxed); }
+
+private:
+    static const int MINCAPACITY = 1024;
+    static const int RELEASERESERVE = 128;
+
+    // The events the reserve is kept for. These match what the processor
+    // treats as sustain off (bit 6 clear) and all notes off (123 and up).
+    static bool releasesNotes(const MidiEvent &event)
+    {
+        if (event.type == MidiEvent::NoteOff) return true;
+        if (event.type != MidiEvent::Controller) return false;
+        return (event.data1 == 0x40 && (event.data2 & 0x40) == 0) || event.data1 > 0x7A;
+    }
+
+    std::vector<MidiEvent> events = std::vector<MidiEvent>(size_t(MINCAPACITY));
+    int numEvents = 0;
+    std::atomic<uint32_t> overflowCount { 0 };
+};
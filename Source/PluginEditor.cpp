@@ -1,15 +1,14 @@
 #include "PluginEditor.h"
 
 DX10AudioProcessorEditor::DX10AudioProcessorEditor(DX10AudioProcessor& p)
-    : AudioProcessorEditor(&p), audioProcessor(p)
+    : AudioProcessorEditor(&p), audioProcessor(p), spectrumAnalyzer(p.getAnalyzerFeed()), loadMeter(p)
 {
     setLookAndFeel(&customLookAndFeel);
+    setOpaque(true);
 
     // Initialize preset manager
     presetManager = std::make_unique<PresetManager>(audioProcessor.apvts);
 
-    // Connect spectrum analyzer to processor
-    audioProcessor.setSpectrumAnalyzer(&spectrumAnalyzer);
     addAndMakeVisible(spectrumAnalyzer);
 
     // Setup knobs
@@ -112,8 +111,12 @@ DX10AudioProcessorEditor::DX10AudioProcessorEditor(DX10AudioProcessor& p)
     settingsButton.onClick = [this]() { showSettingsMenu(); };
     addAndMakeVisible(settingsButton);
 
-    // Spectrum analyzer always visible
+    // Spectrum analyzer always visible, with the spectrogram beside it
     addAndMakeVisible(spectrumAnalyzer);
+    spectrumAnalyzer.onNewSpectrum = [this](const float* spectrum, int numBins) { spectrogram.addFrame(spectrum, numBins); };
+    addAndMakeVisible(spectrogram);
+
+    addAndMakeVisible(loadMeter);
 
     // Save button
     savePresetButton.setColour(juce::TextButton::buttonColourId, juce::Colour(0xFF2A2A35));
@@ -184,7 +187,6 @@ DX10AudioProcessorEditor::DX10AudioProcessorEditor(DX10AudioProcessor& p)
 
 DX10AudioProcessorEditor::~DX10AudioProcessorEditor()
 {
-    audioProcessor.setSpectrumAnalyzer(nullptr);
     audioProcessor.apvts.removeParameterListener("SelectedPresetId", this);
     setLookAndFeel(nullptr);
 }
@@ -199,6 +201,57 @@ void DX10AudioProcessorEditor::showSettingsMenu()
     menu.addItem(3, "Open Preset Folder");
     menu.addSeparator();
     menu.addItem(4, "Refresh Preset List");
+    menu.addSeparator();
+    menu.addItem(5, "Smooth Parameter Automation", true, audioProcessor.getSmoothAutomation());
+    menu.addItem(6, "High Quality Offline Rendering", true, audioProcessor.getOfflineQuality());
+    menu.addSeparator();
+    menu.addItem(7, "Export Block Timing...");
+    menu.addItem(8, "Save Block Timing On Unload", true, audioProcessor.getSaveTelemetryOnUnload());
+
+    // Oversampling (IDs 10-13 select the factor, 14 toggles the filter type)
+    juce::PopupMenu oversamplingMenu;
+    const int factorIndex = audioProcessor.getOversamplingFactorIndex();
+    const bool linearPhase = audioProcessor.getOversamplingLinearPhase();
+    oversamplingMenu.addItem(10, "Off", true, factorIndex == 0);
+    oversamplingMenu.addItem(11, "2x", true, factorIndex == 1);
+    oversamplingMenu.addItem(12, "4x", true, factorIndex == 2);
+    oversamplingMenu.addItem(13, "8x", true, factorIndex == 3);
+    oversamplingMenu.addSeparator();
+    oversamplingMenu.addItem(14, "Linear Phase Filters", true, linearPhase);
+    menu.addSubMenu("Oversampling", oversamplingMenu);
+
+    // Render threads (IDs 20-27 select the number of worker threads, 30-33
+    // the number of voices at which the workers start helping)
+    juce::PopupMenu threadsMenu;
+    const int renderThreads = audioProcessor.getRenderThreads();
+    const int maxThreads = juce::jlimit(0, VoiceRenderPool::MAXTHREADS, juce::SystemStats::getNumCpus() - 1);
+    threadsMenu.addItem(20, "Off", true, renderThreads == 0);
+    for (int i = 1; i <= maxThreads; ++i)
+        threadsMenu.addItem(20 + i, juce::String(i) + (i == 1 ? " Worker" : " Workers"), true, renderThreads == i);
+    threadsMenu.addSeparator();
+    const int threshold = audioProcessor.getThreadingThreshold();
+    for (int i = 0; i < 4; ++i)
+        threadsMenu.addItem(30 + i, "From " + juce::String(8 << i) + " Voices", renderThreads > 0, threshold == (8 << i));
+    menu.addSubMenu("Render Threads", threadsMenu);
+
+    // Voice stealing (IDs 40-42 select the policy)
+    juce::PopupMenu stealingMenu;
+    const int stealPolicy = int(audioProcessor.getStealPolicy());
+    stealingMenu.addItem(40, "Quietest Voice", true, stealPolicy == 0);
+    stealingMenu.addItem(41, "Oldest Voice", true, stealPolicy == 1);
+    stealingMenu.addItem(42, "Released Voices First", true, stealPolicy == 2);
+    menu.addSubMenu("Voice Stealing", stealingMenu);
+
+    // Analyzer (IDs 50-55 select the FFT size, 60-63 the overlap)
+    juce::PopupMenu analyzerMenu;
+    auto& analyzerFeed = audioProcessor.getAnalyzerFeed();
+    for (int order = AnalyzerFeed::MINORDER; order <= AnalyzerFeed::MAXORDER; ++order)
+        analyzerMenu.addItem(50 + order - AnalyzerFeed::MINORDER, juce::String(1 << order) + " Point FFT", true, analyzerFeed.getFftOrder() == order);
+    analyzerMenu.addSeparator();
+    const char* overlapNames[] = { "No Overlap", "50% Overlap", "75% Overlap", "87.5% Overlap" };
+    for (int i = 0; i <= AnalyzerFeed::MAXOVERLAP; ++i)
+        analyzerMenu.addItem(60 + i, overlapNames[i], true, analyzerFeed.getOverlap() == i);
+    menu.addSubMenu("Analyzer", analyzerMenu);
     
     menu.showMenuAsync(juce::PopupMenu::Options().withTargetComponent(&settingsButton),
         [this](int result)
@@ -216,6 +269,39 @@ void DX10AudioProcessorEditor::showSettingsMenu()
                 case 4:
                     rebuildPresetList();
                     break;
+                case 5:
+                    audioProcessor.setSmoothAutomation(!audioProcessor.getSmoothAutomation());
+                    break;
+                case 6:
+                    audioProcessor.setOfflineQuality(!audioProcessor.getOfflineQuality());
+                    break;
+                case 7:
+                    exportTelemetry();
+                    break;
+                case 8:
+                    audioProcessor.setSaveTelemetryOnUnload(!audioProcessor.getSaveTelemetryOnUnload());
+                    break;
+                case 10: case 11: case 12: case 13:
+                    audioProcessor.setOversampling(result - 10, audioProcessor.getOversamplingLinearPhase());
+                    break;
+                case 14:
+                    audioProcessor.setOversampling(audioProcessor.getOversamplingFactorIndex(), !audioProcessor.getOversamplingLinearPhase());
+                    break;
+                case 20: case 21: case 22: case 23: case 24: case 25: case 26: case 27:
+                    audioProcessor.setRenderThreads(result - 20);
+                    break;
+                case 30: case 31: case 32: case 33:
+                    audioProcessor.setThreadingThreshold(8 << (result - 30));
+                    break;
+                case 40: case 41: case 42:
+                    audioProcessor.setStealPolicy(DX10AudioProcessor::StealPolicy(result - 40));
+                    break;
+                case 50: case 51: case 52: case 53: case 54: case 55:
+                    audioProcessor.getAnalyzerFeed().setFftOrder(AnalyzerFeed::MINORDER + result - 50);
+                    break;
+                case 60: case 61: case 62: case 63:
+                    audioProcessor.getAnalyzerFeed().setOverlap(result - 60);
+                    break;
             }
         });
 }
@@ -241,6 +327,28 @@ void DX10AudioProcessorEditor::selectPresetFolder()
         });
 }
 
+void DX10AudioProcessorEditor::exportTelemetry()
+{
+    auto chooser = std::make_shared<juce::FileChooser>(
+        "Export Block Timing",
+        DX10AudioProcessor::getTelemetryDirectory().getChildFile("DX10 Block Timing.json"),
+        "*.json;*.csv"
+    );
+
+    chooser->launchAsync(
+        juce::FileBrowserComponent::saveMode | juce::FileBrowserComponent::canSelectFiles | juce::FileBrowserComponent::warnAboutOverwriting,
+        [this, chooser](const juce::FileChooser& fc)
+        {
+            auto file = fc.getResult();
+            if (file != juce::File{}) {
+                // CSV holds the most recent blocks, JSON the histograms
+                if (!file.hasFileExtension("json;csv"))
+                    file = file.withFileExtension("json");
+                audioProcessor.getTelemetry().writeToFile(file);
+            }
+        });
+}
+
 void DX10AudioProcessorEditor::rebuildPresetList()
 {
     presetSelector.clear(juce::dontSendNotification);
@@ -565,6 +673,33 @@ void DX10AudioProcessorEditor::drawSection(juce::Graphics& g, juce::Rectangle<in
 }
 
 void DX10AudioProcessorEditor::paint(juce::Graphics& g)
+{
+    // The static background is drawn once per size and display scale, so
+    // repaints under the knobs and other components are just an image copy
+    const float pixelScale = g.getInternalContext().getPhysicalPixelScaleFactor();
+    if (!backgroundCache.isValid() || !juce::exactlyEqual(backgroundCacheScale, pixelScale)) {
+        backgroundCache = juce::Image(juce::Image::RGB, juce::jmax(1, juce::roundToInt(float(getWidth()) * pixelScale)),
+                                      juce::jmax(1, juce::roundToInt(float(getHeight()) * pixelScale)), false);
+        juce::Graphics cacheGraphics(backgroundCache);
+        cacheGraphics.addTransform(juce::AffineTransform::scale(pixelScale));
+        drawBackground(cacheGraphics);
+        backgroundCacheScale = pixelScale;
+    }
+    g.drawImage(backgroundCache, getLocalBounds().toFloat());
+
+    // Drag overlay
+    if (isDragOver) {
+        auto bounds = getLocalBounds();
+        g.setColour(juce::Colour(0xFF00D4AA).withAlpha(0.15f));
+        g.fillAll();
+        g.setColour(juce::Colour(0xFF00D4AA));
+        g.drawRect(bounds, 3);
+        g.setFont(24.0f);
+        g.drawText("Drop Preset File Here", bounds, juce::Justification::centred);
+    }
+}
+
+void DX10AudioProcessorEditor::drawBackground(juce::Graphics& g)
 {
     auto bounds = getLocalBounds();
     float width = float(bounds.getWidth());
@@ -580,16 +715,6 @@ void DX10AudioProcessorEditor::paint(juce::Graphics& g)
     for (float x = 0.0f; x < width; x += gridSize) g.drawLine(x, 0.0f, x, height, 0.5f);
     for (float y = 0.0f; y < height; y += gridSize) g.drawLine(0.0f, y, width, y, 0.5f);
 
-    // Drag overlay
-    if (isDragOver) {
-        g.setColour(juce::Colour(0xFF00D4AA).withAlpha(0.15f));
-        g.fillAll();
-        g.setColour(juce::Colour(0xFF00D4AA));
-        g.drawRect(bounds, 3);
-        g.setFont(24.0f);
-        g.drawText("Drop Preset File Here", bounds, juce::Justification::centred);
-    }
-
     float scale = width / 840.0f;
     int margin = int(16.0f * scale);
     int headerHeight = int(70.0f * scale);
@@ -631,6 +756,8 @@ void DX10AudioProcessorEditor::paint(juce::Graphics& g)
 
 void DX10AudioProcessorEditor::resized()
 {
+    backgroundCache = {};
+
     auto bounds = getLocalBounds();
     float scale = float(bounds.getWidth()) / 840.0f;
     
@@ -664,20 +791,21 @@ void DX10AudioProcessorEditor::resized()
     presetSelector.setBounds(prevPresetButton.getRight() + 2, headerY, presetSelectorWidth, buttonHeight);
     nextPresetButton.setBounds(presetSelector.getRight() + 2, headerY, smallButtonWidth, buttonHeight);
 
-    // Spectrum toggle button (bottom left, just above where spectrum would be)
-    int spectrumButtonWidth = int(70.0f * scale);
-    // Position will be set after contentBounds is calculated
+    // Load meter under the preset selector and buttons
+    int meterY = headerY + buttonHeight + int(4.0f * scale);
+    loadMeter.setBounds(presetAreaX, meterY, redoButton.getRight() - presetAreaX, headerHeight - 4 - meterY);
 
     auto contentBounds = bounds.reduced(margin, margin / 2);
     int sectionWidth = (contentBounds.getWidth() - sectionGap * 2) / 3;
     int topRowHeight = int(130.0f * scale);
     int midRowHeight = int(130.0f * scale);
     int bottomRowHeight = int(130.0f * scale);
-    int spectrumHeight = int(100.0f * scale);
 
-    // Spectrum analyzer at bottom
+    // Spectrum analyzer and spectrogram at bottom
     int spectrumY = contentBounds.getY() + topRowHeight + midRowHeight + bottomRowHeight + sectionGap * 3;
-    spectrumAnalyzer.setBounds(contentBounds.getX(), spectrumY, contentBounds.getWidth(), contentBounds.getBottom() - spectrumY);
+    int spectrumWidth = (contentBounds.getWidth() - sectionGap) / 2;
+    spectrumAnalyzer.setBounds(contentBounds.getX(), spectrumY, spectrumWidth, contentBounds.getBottom() - spectrumY);
+    spectrogram.setBounds(contentBounds.getRight() - spectrumWidth, spectrumY, spectrumWidth, contentBounds.getBottom() - spectrumY);
 
     // Row 1: Carrier Envelope
     auto carrierBounds = juce::Rectangle<int>(contentBounds.getX(), contentBounds.getY(), sectionWidth, topRowHeight);
@@ -5,6 +5,8 @@
 #include "CustomLookAndFeel.h"
 #include "RotaryKnobWithLabel.h"
 #include "SpectrumAnalyzer.h"
+#include "Spectrogram.h"
+#include "LoadMeter.h"
 #include "PresetManager.h"
 #include <vector>
 #include <map>
@@ -51,6 +53,10 @@ private:
 
     // Spectrum Analyzer
     SpectrumAnalyzer spectrumAnalyzer;
+    Spectrogram spectrogram;
+
+    // DSP load, voice count and xrun risk, below the preset selector
+    LoadMeter loadMeter;
 
     // Knobs
     RotaryKnobWithLabel attackKnob, decayKnob, releaseKnob;
@@ -71,6 +77,7 @@ private:
 
     void setupKnob(RotaryKnobWithLabel& knob, const juce::String& labelText);
     void drawSection(juce::Graphics& g, juce::Rectangle<int> bounds, const juce::String& title);
+    void drawBackground(juce::Graphics& g);
     void updatePresetSelectorFromParameter();
     void savePresetToFile();
     void loadPresetFromFile();
@@ -79,10 +86,16 @@ private:
     void rebuildPresetList();
     void showSettingsMenu();
     void selectPresetFolder();
+    void exportTelemetry();
     int generatePresetIdFromFile(const juce::File& file);
 
     juce::ComponentBoundsConstrainer constrainer;
 
+    // Background, header and section panels, redrawn only after a resize
+    // or a change of display scale
+    juce::Image backgroundCache;
+    float backgroundCacheScale = 0.0f;
+
     // Preset list data
     int numFactoryPresets = 0;
     std::vector<FlatPresetItem> userPresets;
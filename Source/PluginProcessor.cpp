@@ -1,14 +1,16 @@
 #include "PluginProcessor.h"
 #include "PluginEditor.h"
-#include "SpectrumAnalyzer.h"
 
-DX10Program::DX10Program(const char *name,
+// IDs of the parameters used by the DSP, in DSPParam order.
+static const char *const dspParamIds[] = {"Attack","Decay","Release","Coarse","Fine","Mod Init","Mod Dec","Mod Sus","Mod Rel","Mod Vel","Vibrato","Octave","FineTune","Waveform","Mod Thru","LFO Rate","Gain","Saturation","Polyphony"};
+
+DX10Program::DX10Program(const char *programName,
                          float p0,  float p1,  float p2,  float p3,
                          float p4,  float p5,  float p6,  float p7,
                          float p8,  float p9,  float p10, float p11,
                          float p12, float p13, float p14, float p15)
 {
-    strcpy(this->name, name);
+    strcpy(name, programName);
     param[0]  = p0;  param[1]  = p1;  param[2]  = p2;  param[3]  = p3;
     param[4]  = p4;  param[5]  = p5;  param[6]  = p6;  param[7]  = p7;
     param[8]  = p8;  param[9]  = p9;  param[10] = p10; param[11] = p11;
@@ -23,16 +25,45 @@ DX10AudioProcessor::DX10AudioProcessor()
     createPrograms();
     _currentProgram = 15;  // Log Drum preset
     _currentPresetName = _programs[15].name;  // Set initial preset name
+
+    // The oversamplers are built once, so reportLatency() can read them from
+    // the message thread while prepareToPlay() only resizes their buffers
+    for (int type = 0; type < 2; ++type) {
+        const auto filter = type == 0 ? juce::dsp::Oversampling<float>::filterHalfBandPolyphaseIIR
+                                      : juce::dsp::Oversampling<float>::filterHalfBandFIREquiripple;
+        for (int i = 0; i < NOVERSAMPLING - 1; ++i)
+            _oversamplers[type][i] = std::make_unique<juce::dsp::Oversampling<float>>(1, size_t(i + 1), filter, true, true);
+    }
+
+    // Resolve the DSP parameters once and listen for changes to them
+    _hostIndexToParam.assign(size_t(getParameters().size()), -1);
+    for (int i = 0; i < NUMDSPPARAMS; ++i) {
+        auto* param = apvts.getParameter(dspParamIds[i]);
+        _params[i] = apvts.getRawParameterValue(dspParamIds[i]);
+        _hostIndexToParam[size_t(param->getParameterIndex())] = i;
+        param->addListener(this);
+    }
     
     // Initialize parameters to Log Drum preset values
-    const char *paramNames[] = {"Attack","Decay","Release","Coarse","Fine","Mod Init","Mod Dec","Mod Sus","Mod Rel","Mod Vel","Vibrato","Octave","FineTune","Waveform","Mod Thru","LFO Rate"};
     for (int i = 0; i < NPARAMS; ++i) {
-        if (auto* param = apvts.getParameter(paramNames[i]))
+        if (auto* param = apvts.getParameter(dspParamIds[i]))
             param->setValueNotifyingHost(_programs[15].param[i]);
     }
 }
 
-DX10AudioProcessor::~DX10AudioProcessor() {}
+DX10AudioProcessor::~DX10AudioProcessor()
+{
+    for (int i = 0; i < NUMDSPPARAMS; ++i)
+        apvts.getParameter(dspParamIds[i])->removeListener(this);
+
+    if (_saveTelemetryOnUnload && _telemetry.getNumBlocks() > 0)
+        _telemetry.writeToFile(getTelemetryDirectory().getChildFile("DX10 " + juce::Time::getCurrentTime().formatted("%Y-%m-%d %H-%M-%S") + ".json"));
+}
+
+juce::File DX10AudioProcessor::getTelemetryDirectory()
+{
+    return juce::File::getSpecialLocation(juce::File::userApplicationDataDirectory).getChildFile("DX10").getChildFile("Telemetry");
+}
 
 const juce::String DX10AudioProcessor::getName() const { return JucePlugin_Name; }
 int DX10AudioProcessor::getNumPrograms() { return int(_programs.size()); }
@@ -52,10 +83,10 @@ void DX10AudioProcessor::setCurrentProgram(int index)
     if (index < 0 || index >= static_cast<int>(_programs.size())) return;
     
     // Begin undo transaction for preset change
-    undoManager.beginNewTransaction("Load Preset: " + juce::String(_programs[index].name));
+    undoManager.beginNewTransaction("Load Preset: " + juce::String(_programs[size_t(index)].name));
     
     _currentProgram = index;
-    _currentPresetName = _programs[index].name;  // Set the preset name
+    _currentPresetName = _programs[size_t(index)].name;  // Set the preset name
     
     // Update PresetIndex parameter
     if (auto* param = apvts.getParameter("PresetIndex"))
@@ -66,9 +97,8 @@ void DX10AudioProcessor::setCurrentProgram(int index)
         param->setValueNotifyingHost(param->convertTo0to1(static_cast<float>(index + 1)));
 
     // Only set the 16 original FM synth parameters, preserve Gain and Saturation
-    const char *paramNames[] = {"Attack","Decay","Release","Coarse","Fine","Mod Init","Mod Dec","Mod Sus","Mod Rel","Mod Vel","Vibrato","Octave","FineTune","Waveform","Mod Thru","LFO Rate"};
     for (int i = 0; i < NPARAMS; ++i)
-        apvts.getParameter(paramNames[i])->setValueNotifyingHost(_programs[index].param[i]);
+        apvts.getParameter(dspParamIds[i])->setValueNotifyingHost(_programs[size_t(index)].param[i]);
     
     // Notify host of program change
     updateHostDisplay(ChangeDetails().withProgramChanged(true));
@@ -81,21 +111,128 @@ const juce::String DX10AudioProcessor::getProgramName(int index)
         return _currentPresetName;
     
     if (index >= 0 && index < static_cast<int>(_programs.size())) 
-        return { _programs[index].name };
+        return { _programs[size_t(index)].name };
     return {};
 }
 
 juce::String DX10AudioProcessor::getPresetName(int index) const
 {
-    if (index >= 0 && index < static_cast<int>(_programs.size())) return { _programs[index].name };
+    if (index >= 0 && index < static_cast<int>(_programs.size())) return { _programs[size_t(index)].name };
     return {};
 }
 
 void DX10AudioProcessor::changeProgramName(int, const juce::String&) {}
-void DX10AudioProcessor::prepareToPlay(double sampleRate, int) { _sampleRate = sampleRate; _inverseSampleRate = 1.0f / _sampleRate; resetState(); }
+void DX10AudioProcessor::prepareToPlay(double sampleRate, int samplesPerBlock)
+{
+    _hostSampleRate = sampleRate;
+    _maxBlockSize = juce::jmax(1, samplesPerBlock);
+    _events.prepare(_maxBlockSize);
+    _renderBuffer.assign(size_t(_maxBlockSize), 0.0f);
+    _loadMeasurer.reset(sampleRate, _maxBlockSize);
+    _telemetry.setSampleRate(sampleRate);
+
+    for (auto &oversamplers : _oversamplers)
+        for (auto &oversampler : oversamplers) oversampler->initProcessing(size_t(_maxBlockSize));
+
+    _activeOversampling = -1;
+    updateOversampling();
+    resetState();
+    reportLatency();
+}
+
+// Sets the rate the voices run at. Everything that depends on it is
+// recomputed, and the sounding voices are carried over to the new rate.
+void DX10AudioProcessor::setRenderSampleRate(double sampleRate)
+{
+    const float ratio = _sampleRate / float(sampleRate);
+    _sampleRate = float(sampleRate); _inverseSampleRate = 1.0f / _sampleRate;
+    _dirtyParams = ~0u;
+    update();
+    startPendingRamps();
+    rescaleVoices(ratio);
+
+    // Start the ramps at their targets instead of fading in from 0
+    _richnessRamp.reset(sampleRate, SMOOTHINGTIME); _modMixRamp.reset(sampleRate, SMOOTHINGTIME);
+    _gainRamp.reset(sampleRate, SMOOTHINGTIME); _saturationRamp.reset(sampleRate, SMOOTHINGTIME);
+    _bendRamp.reset(sampleRate, BENDSMOOTHINGTIME);
+    _stealFade = std::exp(-_inverseSampleRate / 0.0006f);
+}
+
+void DX10AudioProcessor::setOversampling(int factorIndex, bool linearPhase)
+{
+    factorIndex = juce::jlimit(0, NOVERSAMPLING - 1, factorIndex);
+    _oversamplingFactorIndex = factorIndex;
+    _oversamplingLinearPhase = linearPhase;
+    reportLatency();
+}
+
+void DX10AudioProcessor::setOfflineQuality(bool shouldBoost)
+{
+    _offlineQuality = shouldBoost;
+    reportLatency();
+}
+
+// Hosts switch to non-realtime before a bounce starts, which is when the
+// latency of the offline oversampling factor has to be reported.
+void DX10AudioProcessor::setNonRealtime(bool isNonRealtime) noexcept
+{
+    juce::AudioProcessor::setNonRealtime(isNonRealtime);
+    reportLatency();
+}
+
+int DX10AudioProcessor::getEffectiveOversamplingFactorIndex() const
+{
+    const int factorIndex = _oversamplingFactorIndex;
+    return _offlineQuality && isNonRealtime() ? juce::jmax(factorIndex, OFFLINEOVERSAMPLING) : factorIndex;
+}
+
+// Tells the host the latency of the oversampling filters that will be used.
+void DX10AudioProcessor::reportLatency()
+{
+    const int factorIndex = getEffectiveOversamplingFactorIndex();
+    int latency = 0;
+    if (factorIndex > 0)
+        latency = juce::roundToInt(_oversamplers[_oversamplingLinearPhase ? 1 : 0][factorIndex - 1]->getLatencyInSamples());
+    setLatencySamples(latency);
+}
+
+// Reports the release tail plus the samples the oversampling filters hold
+// back. Hosts may cache the tail, so a change is announced to them, from the
+// message thread. JUCE has no flag for the tail alone; the latency flag is
+// the one that makes the wrappers ask for the processing properties again.
+void DX10AudioProcessor::updateTailLength()
+{
+    const double tail = _releaseTailSeconds + double(_oversamplerTailLength) / _hostSampleRate;
+    if (!juce::exactlyEqual(tail, _tailLengthSeconds.exchange(tail))) triggerAsyncUpdate();
+}
+
+void DX10AudioProcessor::handleAsyncUpdate() { updateHostDisplay(ChangeDetails().withLatencyChanged(true)); }
+
+// Picks up a change of oversampling settings at the start of a block.
+void DX10AudioProcessor::updateOversampling()
+{
+    const int factorIndex = getEffectiveOversamplingFactorIndex();
+    const int type = _oversamplingLinearPhase ? 1 : 0;
+    const int requested = factorIndex + NOVERSAMPLING * type;
+    if (requested == _activeOversampling) return;
+
+    _activeOversampling = requested;
+    _oversamplingFactor = 1 << factorIndex;
+    _oversampler = factorIndex > 0 ? _oversamplers[type][factorIndex - 1].get() : nullptr;
+    if (_oversampler != nullptr) _oversampler->reset();
+    _oversamplerTailLength = _oversampler != nullptr ? juce::jmax(64, 2 * int(std::ceil(_oversampler->getLatencyInSamples()))) : 0;
+    _oversamplerTail = juce::jmin(_oversamplerTail, _oversamplerTailLength);
+    setRenderSampleRate(_hostSampleRate * _oversamplingFactor);
+}
+
 void DX10AudioProcessor::releaseResources() {}
 void DX10AudioProcessor::reset() { resetState(); }
-bool DX10AudioProcessor::isBusesLayoutSupported(const BusesLayout &layouts) const { return layouts.getMainOutputChannelSet() == juce::AudioChannelSet::stereo(); }
+bool DX10AudioProcessor::isBusesLayoutSupported(const BusesLayout &layouts) const
+{
+    // The synth is mono, so a mono output lets the host skip the copy to a second channel
+    const auto output = layouts.getMainOutputChannelSet();
+    return output == juce::AudioChannelSet::stereo() || output == juce::AudioChannelSet::mono();
+}
 
 void DX10AudioProcessor::createPrograms()
 {
@@ -135,186 +272,593 @@ void DX10AudioProcessor::createPrograms()
 
 void DX10AudioProcessor::resetState()
 {
-    for (int v = 0; v < NVOICES; ++v) { _voices[v].env = 0.0f; _voices[v].car = 0.0f; _voices[v].dcar = 0.0f; _voices[v].mod0 = 0.0f; _voices[v].mod1 = 0.0f; _voices[v].dmod = 0.0f; _voices[v].cdec = 0.99f; }
-    _numActiveVoices = 0; _notes[0] = EVENTS_DONE; _modWheel = 0.0f; _pitchBend = 1.0f; _volume = 0.0035f; _sustain = 0; _lfoStep = 0; _lfo0 = 0.0f; _lfo1 = 1.0f; _modulationAmount = 0.0f;
+    for (int v = 0; v < NSLOTS; ++v) { _voices.env[v] = 0.0f; _voices.car[v] = 0.0f; _voices.dcar[v] = 0.0f; _voices.mod0[v] = 0.0f; _voices.mod1[v] = 0.0f; _voices.dmod[v] = 0.0f; _voices.cdec[v] = 0.99f; }
+    _numActiveVoices = 0; _allocator.reset(); _events.clear(); _modWheel = 0.0f; _pitchBend = 1.0f; _bendRamp.setCurrentAndTargetValue(1.0f); _modulatorBend = 1.0f; _volume = 0.0035f; _sustain = 0; _lfoStep = 0; _lfo0 = 0.0f; _lfo1 = 1.0f; _modulationAmount = 0.0f; _oversamplerTail = 0; _hostPosition = 0;
+}
+
+void DX10AudioProcessor::parameterValueChanged(int parameterIndex, float)
+{
+    if (parameterIndex >= 0 && parameterIndex < int(_hostIndexToParam.size())) {
+        const int param = _hostIndexToParam[size_t(parameterIndex)];
+        if (param >= 0) _dirtyParams.fetch_or(1u << param);
+    }
 }
 
+// Recomputes the DSP coefficients for the parameters that have changed since
+// the last block. Most blocks have nothing to do here.
 void DX10AudioProcessor::update()
 {
-    float param11 = apvts.getRawParameterValue("Octave")->load();
-    _tune = 8.175798915644f * _inverseSampleRate * std::pow(2.0f, std::floor(param11 * 6.9f) - 2.0f);
-    float param12 = apvts.getRawParameterValue("FineTune")->load();
-    _fineTune = param12 + param12 - 1.0f;
-    float coarse = apvts.getRawParameterValue("Coarse")->load();
-    coarse = std::floor(40.1f * coarse * coarse);
-    float fine = apvts.getRawParameterValue("Fine")->load();
-    if (fine < 0.5f) { fine = 0.2f * fine * fine; }
-    else { switch (int(8.9f * fine)) { case 4: fine = 0.25f; break; case 5: fine = 0.33333333f; break; case 6: fine = 0.50f; break; case 7: fine = 0.66666667f; break; default: fine = 0.75f; } }
-    _ratio = 1.570796326795f * (coarse + fine);
-    _velocitySensitivity = apvts.getRawParameterValue("Mod Vel")->load();
-    float param10 = apvts.getRawParameterValue("Vibrato")->load();
-    _vibrato = 0.001f * param10 * param10;
-    float param0 = apvts.getRawParameterValue("Attack")->load();
-    _attack = 1.0f - std::exp(-_inverseSampleRate * std::exp(8.0f - 8.0f * param0));
-    float param1 = apvts.getRawParameterValue("Decay")->load();
-    if (param1 > 0.98f) { _decay = 1.0f; } else { _decay = std::exp(-_inverseSampleRate * std::exp(5.0f - 8.0f * param1)); }
-    float param2 = apvts.getRawParameterValue("Release")->load();
-    _release = std::exp(-_inverseSampleRate * std::exp(5.0f - 5.0f * param2));
-    float param5 = apvts.getRawParameterValue("Mod Init")->load();
-    _modInitialLevel = 0.0002f * param5 * param5;
-    float param6 = apvts.getRawParameterValue("Mod Dec")->load();
-    _modDecay = 1.0f - std::exp(-_inverseSampleRate * std::exp(6.0f - 7.0f * param6));
-    float param7 = apvts.getRawParameterValue("Mod Sus")->load();
-    _modSustain = 0.0002f * param7 * param7;
-    float param8 = apvts.getRawParameterValue("Mod Rel")->load();
-    _modRelease = 1.0f - std::exp(-_inverseSampleRate * std::exp(5.0f - 8.0f * param8));
-    float param13 = apvts.getRawParameterValue("Waveform")->load();
-    _richness = 0.50f - 3.0f * param13 * param13;
-    float param14 = apvts.getRawParameterValue("Mod Thru")->load();
-    _modMix = 0.25f * param14 * param14;
-    float param15 = apvts.getRawParameterValue("LFO Rate")->load();
-    _lfoInc = 628.3f * _inverseSampleRate * 25.0f * param15 * param15;
+    const uint32_t dirty = _dirtyParams.exchange(0);
+    if (dirty == 0) return;
+    auto changed = [dirty](DSPParam p) { return (dirty & (1u << p)) != 0; };
+    auto value = [this](DSPParam p) { return _params[p]->load(); };
+
+    if (changed(Octave)) { float param11 = value(Octave); _tune = 8.175798915644f * _inverseSampleRate * std::pow(2.0f, std::floor(param11 * 6.9f) - 2.0f); }
+    if (changed(FineTune)) { float param12 = value(FineTune); _fineTune = param12 + param12 - 1.0f; }
+    if (changed(Coarse) || changed(Fine)) {
+        float coarse = value(Coarse);
+        coarse = std::floor(40.1f * coarse * coarse);
+        float fine = value(Fine);
+        if (fine < 0.5f) { fine = 0.2f * fine * fine; }
+        else { switch (int(8.9f * fine)) { case 4: fine = 0.25f; break; case 5: fine = 0.33333333f; break; case 6: fine = 0.50f; break; case 7: fine = 0.66666667f; break; default: fine = 0.75f; } }
+        _ratio = 1.570796326795f * (coarse + fine);
+    }
+    if (changed(ModVel)) _velocitySensitivity = value(ModVel);
+    if (changed(Vibrato)) { float param10 = value(Vibrato); _vibrato = 0.001f * param10 * param10; }
+    if (changed(Attack)) { float param0 = value(Attack); _attack = 1.0f - std::exp(-_inverseSampleRate * std::exp(8.0f - 8.0f * param0)); }
+    if (changed(Decay)) { float param1 = value(Decay); if (param1 > 0.98f) { _decay = 1.0f; } else { _decay = std::exp(-_inverseSampleRate * std::exp(5.0f - 8.0f * param1)); } }
+    if (changed(Release)) {
+        float param2 = value(Release); _release = std::exp(-_inverseSampleRate * std::exp(5.0f - 5.0f * param2));
+        // The envelope peaks at about 1.2 (full velocity and CC 7, Waveform 0)
+        // and decays with a time constant of exp(5 * param2 - 5) seconds. The
+        // modulator is only heard through the carrier, so Mod Rel can't make
+        // the tail any longer.
+        _releaseTailSeconds = std::log(1.2 / SILENCE) * std::exp(5.0 * param2 - 5.0);
+        updateTailLength();
+    }
+    if (changed(ModInit)) { float param5 = value(ModInit); _modInitialLevel = 0.0002f * param5 * param5; }
+    if (changed(ModDec)) { float param6 = value(ModDec); _modDecay = 1.0f - std::exp(-_inverseSampleRate * std::exp(6.0f - 7.0f * param6)); }
+    if (changed(ModSus)) { float param7 = value(ModSus); _modSustain = 0.0002f * param7 * param7; }
+    if (changed(ModRel)) { float param8 = value(ModRel); _modRelease = 1.0f - std::exp(-_inverseSampleRate * std::exp(5.0f - 8.0f * param8)); }
+    if (changed(Waveform)) { _waveform = value(Waveform); _richness = 0.50f - 3.0f * _waveform * _waveform; }
+    if (changed(ModThru)) { float param14 = value(ModThru); _modMix = 0.25f * param14 * param14; }
+    if (changed(LFORate)) { float param15 = value(LFORate); _lfoInc = 628.3f * _inverseSampleRate * 25.0f * param15 * param15; if (_offline) _lfoInc /= float(LFOINTERVAL + 1); }
     
     // Output section
-    float gainParam = apvts.getRawParameterValue("Gain")->load();
-    _outputGain = std::pow(10.0f, (gainParam * 24.0f - 12.0f) / 20.0f);  // -12dB to +12dB
-    _saturation = apvts.getRawParameterValue("Saturation")->load();
+    if (changed(Gain)) { float gainParam = value(Gain); _outputGain = std::pow(10.0f, (gainParam * 24.0f - 12.0f) / 20.0f); }  // -12dB to +12dB
+    if (changed(Saturation)) _saturation = value(Saturation);
+
+    if (changed(Polyphony)) _polyphony = int(value(Polyphony));
+
+    // Smoothed ramps start at the next automation grid point, see
+    // startPendingRamps(). Unsmoothed values apply at once, as they always have.
+    _pendingRamps |= dirty & ((1u << Waveform) | (1u << ModThru) | (1u << Gain) | (1u << Saturation));
+    if (!_smoothAutomation && !_offline) startPendingRamps();
 }
 
+// Moves the ramps of the parameters changed since the last grid point to
+// their new targets. When smoothing, this is only called on the
+// AUTOMATIONINTERVAL grid.
+void DX10AudioProcessor::startPendingRamps()
+{
+    const bool smooth = _smoothAutomation || _offline;
+    auto retarget = [smooth](juce::SmoothedValue<float> &ramp, float target) { if (smooth) ramp.setTargetValue(target); else ramp.setCurrentAndTargetValue(target); };
+    auto pending = [this](DSPParam p) { return (_pendingRamps & (1u << p)) != 0; };
+    if (pending(Waveform)) retarget(_richnessRamp, _richness);
+    if (pending(ModThru)) retarget(_modMixRamp, _modMix);
+    if (pending(Gain)) retarget(_gainRamp, _outputGain);
+    if (pending(Saturation)) retarget(_saturationRamp, _saturation);
+    _pendingRamps = 0;
+}
+
+// Writes the next numSamples values of a parameter ramp into dest.
+static void fillRamp(juce::SmoothedValue<float> &ramp, float *dest, int numSamples)
+{
+    if (ramp.isSmoothing()) { for (int i = 0; i < numSamples; ++i) dest[i] = ramp.getNextValue(); }
+    else { juce::FloatVectorOperations::fill(dest, ramp.getTargetValue(), numSamples); }
+}
+
+// Decodes the block's MIDI into _events. Nothing is applied yet: the events
+// are handled at their sample positions by renderBlock().
 void DX10AudioProcessor::processEvents(juce::MidiBuffer &midiMessages)
 {
-    int npos = 0;
+    _events.clear();
     for (const auto metadata : midiMessages) {
-        if (metadata.numBytes != 3) continue;
-        const auto data0 = metadata.data[0]; const auto data1 = metadata.data[1]; const auto data2 = metadata.data[2];
+        const auto data0 = metadata.data[0];
+        const int data1 = metadata.numBytes > 1 ? metadata.data[1] & 0x7F : 0;
+        const int data2 = metadata.numBytes > 2 ? metadata.data[2] & 0x7F : 0;
         const int deltaFrames = metadata.samplePosition;
         switch (data0 & 0xf0) {
-            case 0x80: _notes[npos++] = deltaFrames; _notes[npos++] = data1 & 0x7F; _notes[npos++] = 0; break;
-            case 0x90: _notes[npos++] = deltaFrames; _notes[npos++] = data1 & 0x7F; _notes[npos++] = data2 & 0x7F; break;
-            case 0xB0:
-                switch (data1) {
-                    case 0x01: _modWheel = 0.00000005f * float(data2 * data2); break;
-                    case 0x07: _volume = 0.00000035f * float(data2 * data2); break;
-                    case 0x40: _sustain = data2 & 0x40; if (_sustain == 0) { _notes[npos++] = deltaFrames; _notes[npos++] = SUSTAIN; _notes[npos++] = 0; } break;
-                    default: if (data1 > 0x7A) { for (int v = 0; v < NVOICES; ++v) _voices[v].cdec = 0.99f; _sustain = 0; } break;
-                }
-                break;
-            case 0xC0: if (data1 < _programs.size()) setCurrentProgram(data1); break;
-            case 0xE0: _pitchBend = float(data1 + 128 * data2 - 8192); _pitchBend = (_pitchBend > 0.0f) ? 1.0f + 0.000014951f * _pitchBend : 1.0f + 0.000013318f * _pitchBend; break;
+            case 0x80: if (metadata.numBytes == 3) _events.push({ deltaFrames, MidiEvent::NoteOff, data1, 0 }); break;
+            case 0x90: if (metadata.numBytes == 3) _events.push({ deltaFrames, data2 > 0 ? MidiEvent::NoteOn : MidiEvent::NoteOff, data1, data2 }); break;
+            case 0xB0: if (metadata.numBytes == 3) _events.push({ deltaFrames, MidiEvent::Controller, data1, data2 }); break;
+            case 0xC0: if (metadata.numBytes >= 2) _events.push({ deltaFrames, MidiEvent::ProgramChange, data1, 0 }); break;
+            case 0xE0: if (metadata.numBytes == 3) _events.push({ deltaFrames, MidiEvent::PitchBend, data1 + 128 * data2, 0 }); break;
             default: break;
         }
-        if (npos > EVENTBUFFER) npos -= 3;
     }
-    _notes[npos] = EVENTS_DONE;
     midiMessages.clear();
 }
 
-void DX10AudioProcessor::processBlock(juce::AudioBuffer<float> &buffer, juce::MidiBuffer &midiMessages)
+void DX10AudioProcessor::handleEvent(const MidiEvent &event)
+{
+    const int data1 = event.data1, data2 = event.data2;
+    switch (event.type) {
+        case MidiEvent::NoteOn: noteOn(data1, data2); break;
+        case MidiEvent::NoteOff: noteOn(data1, 0); break;
+        case MidiEvent::Controller:
+            switch (data1) {
+                case 0x01: _modWheel = 0.00000005f * float(data2 * data2); break;
+                case 0x07: _volume = 0.00000035f * float(data2 * data2); break;
+                case 0x40: _sustain = data2 & 0x40; if (_sustain == 0) releaseSustainedVoices(); break;
+                default:
+                    if (data1 > 0x7A) {  // all notes off
+                        for (int v = 0; v < _numActiveVoices; ++v) {
+                            _voices.cdec[v] = 0.99f;
+                            if (_allocator.getKey(v) != _allocator.STOLEN) _allocator.setKey(v, _allocator.RELEASED);
+                        }
+                        _sustain = 0;
+                    }
+                    break;
+            }
+            break;
+        case MidiEvent::ProgramChange: if (data1 < int(_programs.size())) setCurrentProgram(data1); break;
+        case MidiEvent::PitchBend: _pitchBend = float(data1 - 8192); _pitchBend = (_pitchBend > 0.0f) ? 1.0f + 0.000014951f * _pitchBend : 1.0f + 0.000013318f * _pitchBend; _bendRamp.setTargetValue(_pitchBend); break;
+    }
+}
+
+void DX10AudioProcessor::processBlock(juce::AudioBuffer<float> &buffer, juce::MidiBuffer &midiMessages) { processBlockImpl(buffer, midiMessages); }
+void DX10AudioProcessor::processBlock(juce::AudioBuffer<double> &buffer, juce::MidiBuffer &midiMessages) { processBlockImpl(buffer, midiMessages); }
+
+// Shared by the float and double processBlock(). The voices and the output
+// stage always run in float. A float block is rendered straight into its
+// first channel. A double block is rendered a slice at a time into
+// _renderBuffer and widened from there.
+template <typename SampleType>
+void DX10AudioProcessor::processBlockImpl(juce::AudioBuffer<SampleType> &buffer, juce::MidiBuffer &midiMessages)
 {
+    constexpr bool isFloat = std::is_same<SampleType, float>::value;
+    const auto startTicks = juce::Time::getHighResolutionTicks();
     juce::ScopedNoDenormals noDenormals;
     auto totalNumInputChannels = getTotalNumInputChannels();
     auto totalNumOutputChannels = getTotalNumOutputChannels();
     for (auto i = totalNumInputChannels; i < totalNumOutputChannels; ++i) buffer.clear(i, 0, buffer.getNumSamples());
 
+    // Switching between live and offline quality changes the LFO update rate
+    const bool offline = _offlineQuality && isNonRealtime();
+    if (offline != _offline) { _offline = offline; _dirtyParams.fetch_or(1u << LFORate); }
+
+    updateOversampling();
     update();
     processEvents(midiMessages);
+    const int numEvents = _events.size();
 
     int sampleFrames = buffer.getNumSamples();
-    float *out1 = buffer.getWritePointer(0);
-    float *out2 = buffer.getWritePointer(1);
-    int event = 0, frame = 0;
-
-    if (_numActiveVoices > 0 || _notes[event] < sampleFrames) {
-        while (frame < sampleFrames) {
-            int frames = _notes[event++];
-            if (frames > sampleFrames) frames = sampleFrames;
-            frames -= frame;
-            frame += frames;
-
-            while (--frames >= 0) {
-                Voice *V = _voices;
-                float o = 0.0f;
-                if (--_lfoStep < 0) { _lfo0 += _lfoInc * _lfo1; _lfo1 -= _lfoInc * _lfo0; _modulationAmount = _lfo1 * (_modWheel + _vibrato); _lfoStep = 100; }
-                for (int v = 0; v < NVOICES; ++v) {
-                    float e = V->env;
-                    if (e > SILENCE) {
-                        V->env = e * V->cdec;
-                        V->cenv += V->catt * (e - V->cenv);
-                        float y = V->dmod * V->mod0 - V->mod1; V->mod1 = V->mod0; V->mod0 = y;
-                        V->menv += V->mdec * (V->mlev - V->menv);
-                        float x = V->car + V->dcar + y * V->menv + _modulationAmount;
-                        while (x > 1.0f) x -= 2.0f; while (x < -1.0f) x += 2.0f;
-                        V->car = x;
-                        float s = x + x * x * x * (_richness * x * x - 1.0f - _richness);
-                        o += V->cenv * (_modMix * V->mod1 + s);
-                    }
-                    V++;
-                }
-                
-                // Apply saturation (soft clipping)
-                if (_saturation > 0.0f) {
-                    float satAmount = _saturation * 4.0f;
-                    o = std::tanh(o * (1.0f + satAmount)) / (1.0f + satAmount * 0.5f);
-                }
-                
-                // Apply output gain
-                o *= _outputGain;
-                
-                *out1++ = o; *out2++ = o;
+    SampleType *out1 = buffer.getWritePointer(0);
+
+    // Keep rendering for a while after the last voice ends when oversampling,
+    // so the filters' tail and latency make it out
+    if (_numActiveVoices > 0 || !_events.isEmpty() || _oversamplerTail > 0) {
+        // Render the mono voice sum into the first channel, in slices that
+        // fit the buffers set up in prepareToPlay(), then copy it to the rest
+        int event = 0;
+        for (int frame = 0; frame < sampleFrames; frame += _maxBlockSize) {
+            const int n = juce::jmin(_maxBlockSize, sampleFrames - frame);
+            if constexpr (isFloat) {
+                renderBlock(out1 + frame, frame, n, event);
+            } else {
+                renderBlock(_renderBuffer.data(), frame, n, event);
+                for (int i = 0; i < n; ++i) out1[frame + i] = _renderBuffer[size_t(i)];
+                _analyzerFeed.push(_renderBuffer.data(), n);
             }
-            if (frame < sampleFrames) { int note = _notes[event++]; int vel = _notes[event++]; noteOn(note, vel); }
-        }
-        _numActiveVoices = NVOICES;
-        for (int v = 0; v < NVOICES; ++v) {
-            if (_voices[v].env < SILENCE) { _voices[v].env = 0.0f; _voices[v].cenv = 0.0f; _numActiveVoices--; }
-            if (_voices[v].menv < SILENCE) { _voices[v].menv = 0.0f; _voices[v].mlev = 0.0f; }
         }
+        while (event < _events.size()) handleEvent(_events[event++]);  // stamped past the end of the block
+        for (int channel = 1; channel < buffer.getNumChannels(); ++channel)
+            juce::FloatVectorOperations::copy(buffer.getWritePointer(channel), out1, sampleFrames);
+        removeFinishedVoices();
+        _oversamplerTail = _numActiveVoices > 0 ? _oversamplerTailLength : juce::jmax(0, _oversamplerTail - sampleFrames);
     } else {
-        while (--sampleFrames >= 0) { *out1++ = 0.0f; *out2++ = 0.0f; }
+        // Nothing to render, but the ramps still start on the grid
+        int renderFrames = sampleFrames * _oversamplingFactor;
+        auto skipRamps = [this](int n) { _richnessRamp.skip(n); _modMixRamp.skip(n); _gainRamp.skip(n); _saturationRamp.skip(n); _bendRamp.skip(n); };
+        const int toGrid = int((AUTOMATIONINTERVAL - _hostPosition % AUTOMATIONINTERVAL) % AUTOMATIONINTERVAL) * _oversamplingFactor;
+        if (_pendingRamps != 0 && toGrid < renderFrames) { skipRamps(toGrid); startPendingRamps(); renderFrames -= toGrid; }
+        skipRamps(renderFrames); _modulatorBend = _bendRamp.getCurrentValue();
+        buffer.clear();  // also marks the buffer as silent (AudioBuffer::hasBeenCleared())
+        if constexpr (!isFloat) {
+            juce::FloatVectorOperations::clear(_renderBuffer.data(), _maxBlockSize);
+            for (int frame = 0; frame < sampleFrames; frame += _maxBlockSize)
+                _analyzerFeed.push(_renderBuffer.data(), juce::jmin(_maxBlockSize, sampleFrames - frame));
+        }
+    }
+    _events.clear();
+    _hostPosition += sampleFrames;
+
+    if constexpr (isFloat) _analyzerFeed.push(out1, sampleFrames);
+    measureLoad(startTicks, sampleFrames, numEvents);
+}
+
+// Publishes the cost of the block that just finished for the load meter and
+// the telemetry.
+void DX10AudioProcessor::measureLoad(juce::int64 startTicks, int numSamples, int numEvents)
+{
+    if (numSamples <= 0) return;
+    const double seconds = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - startTicks);
+    _loadMeasurer.registerRenderTime(seconds * 1000.0, numSamples);
+
+    const float load = float(seconds * _hostSampleRate / numSamples);
+    float peak = _peakLoad.load(std::memory_order_relaxed);
+    while (load > peak && !_peakLoad.compare_exchange_weak(peak, load, std::memory_order_relaxed)) {}
+    _numBlocks.fetch_add(1, std::memory_order_relaxed);
+    if (load > HIGHLOAD) _numBlocksOverBudget.fetch_add(1, std::memory_order_relaxed);
+    _numActiveVoicesForDisplay.store(_numActiveVoices, std::memory_order_relaxed);
+    _telemetry.record(seconds, numSamples, _numActiveVoices, numEvents);
+}
+
+// Renders numFrames host samples, starting at startFrame in the block, into
+// out. When oversampling, the voices and the output stage run at the higher
+// rate in the oversampler's buffer, and only the result is brought back down.
+// event is the index in _events of the next event to handle.
+void DX10AudioProcessor::renderBlock(float *out, int startFrame, int numFrames, int &event)
+{
+    float *channels[] = { out };
+    juce::dsp::AudioBlock<float> block(channels, 1, size_t(numFrames));
+    float *dest = out;
+    if (_oversampler != nullptr) {
+        // The oversampler only hands out its buffer by upsampling something,
+        // so give it silence and then overwrite the result.
+        block.clear();
+        dest = _oversampler->processSamplesUp(block).getChannelPointer(0);
+    }
+
+    const int frames = numFrames * _oversamplingFactor;
+    const int chunk = _offline ? OFFLINECHUNK : RENDERCHUNK;
+    const int lfoInterval = _offline ? 0 : LFOINTERVAL;
+    const int grid = AUTOMATIONINTERVAL * _oversamplingFactor;
+    const juce::int64 blockPosition = (_hostPosition + startFrame) * _oversamplingFactor;
+    int frame = 0;
+    while (frame < frames) {
+        const int next = juce::jmax(frame, juce::jmin(_events.getFrame(event) - startFrame, numFrames) * _oversamplingFactor);
+
+        while (frame < next) {
+            // Chunks are cut on grids counted from prepareToPlay(), not from the
+            // start of the block, so where they fall doesn't depend on the
+            // block size. While bending they end every BENDINTERVAL samples, so the
+            // modulators keep up, and with ramps pending they end at the next
+            // automation grid point, where the ramps start.
+            const juce::int64 position = blockPosition + frame;
+            if (_pendingRamps != 0 && position % grid == 0) startPendingRamps();
+            const bool bending = _bendRamp.isSmoothing() || !juce::exactlyEqual(_bendRamp.getCurrentValue(), _modulatorBend);
+            if (bending && position % BENDINTERVAL == 0) retuneModulators(_bendRamp.getCurrentValue());
+            int n = juce::jmin(next - frame, bending ? BENDINTERVAL - int(position % BENDINTERVAL) : chunk);
+            if (_pendingRamps != 0) n = juce::jmin(n, grid - int(position % grid));
+            const bool ramped = _bendRamp.isSmoothing() || _richnessRamp.isSmoothing() || _modMixRamp.isSmoothing();
+            float modulation[OFFLINECHUNK], bend[OFFLINECHUNK], richness[OFFLINECHUNK], modMix[OFFLINECHUNK];
+            for (int i = 0; i < n; ++i) {
+                if (--_lfoStep < 0) { _lfo0 += _lfoInc * _lfo1; _lfo1 -= _lfoInc * _lfo0; _modulationAmount = _lfo1 * (_modWheel + _vibrato); _lfoStep = lfoInterval; }
+                modulation[i] = _modulationAmount;
+            }
+            fillRamp(_bendRamp, bend, n);
+            fillRamp(_richnessRamp, richness, n);
+            fillRamp(_modMixRamp, modMix, n);
+            renderVoices(dest + frame, modulation, bend, richness, modMix, ramped, n);
+
+            // The output stage follows chunk by chunk, so its ramps start on the grid too
+            for (int i = 0; i < n; i += RENDERCHUNK)
+                applyOutputStage(dest + frame + i, juce::jmin(RENDERCHUNK, n - i));
+            frame += n;
+        }
+        if (frame < frames) handleEvent(_events[event++]);
+    }
+
+    if (_oversampler != nullptr)
+        _oversampler->processSamplesDown(block);
+}
+
+// Fast tanh for the saturation stage: a [7/6] Pade approximant with the input
+// clamped to +/-4.97, where it reaches 1. The absolute error is below 1e-4
+// (-80 dB) for any input. There are no branches, so the loop vectorizes.
+static void fastTanh(float *data, int numSamples)
+{
+    for (int i = 0; i < numSamples; ++i) {
+        const float x = juce::jlimit(-4.97f, 4.97f, data[i]);
+        const float x2 = x * x;
+        data[i] = x * (135135.0f + x2 * (17325.0f + x2 * (378.0f + x2))) / (135135.0f + x2 * (62370.0f + x2 * (3150.0f + x2 * 28.0f)));
+    }
+}
+
+// Applies saturation (soft clipping) and output gain to at most RENDERCHUNK
+// samples of the voice sum, as whole-buffer vector operations.
+void DX10AudioProcessor::applyOutputStage(float *data, int numSamples)
+{
+    if (!_saturationRamp.isSmoothing() && !_gainRamp.isSmoothing()) {
+        const float saturation = _saturationRamp.getTargetValue();
+        const float gain = _gainRamp.getTargetValue();
+        if (saturation > 0.0f) {
+            const float satAmount = saturation * 4.0f;
+            juce::FloatVectorOperations::multiply(data, 1.0f + satAmount, numSamples);
+            fastTanh(data, numSamples);
+            juce::FloatVectorOperations::multiply(data, gain / (1.0f + satAmount * 0.5f), numSamples);
+        } else {
+            juce::FloatVectorOperations::multiply(data, gain, numSamples);
+        }
+        return;
+    }
+
+    // Automation in progress: build the per-sample drive and gain first
+    float drive[RENDERCHUNK], gain[RENDERCHUNK];
+    const bool saturate = _saturationRamp.isSmoothing() || _saturationRamp.getTargetValue() > 0.0f;
+    for (int i = 0; i < numSamples; ++i) {
+        const float satAmount = _saturationRamp.getNextValue() * 4.0f;
+        drive[i] = 1.0f + satAmount;
+        gain[i] = _gainRamp.getNextValue() / (1.0f + satAmount * 0.5f);
+    }
+    if (saturate) {
+        juce::FloatVectorOperations::multiply(data, drive, numSamples);
+        fastTanh(data, numSamples);
     }
-    _notes[0] = EVENTS_DONE;
+    juce::FloatVectorOperations::multiply(data, gain, numSamples);
+}
+
+// Renders numSamples of the summed voices into out. The voices are walked in
+// groups of SIMD width, and each group keeps its state in registers for the
+// whole chunk. A voice whose envelope drops below SILENCE stops changing env
+// and stops contributing to the output, exactly like the scalar loop did.
+void DX10AudioProcessor::renderVoices(float *out, const float *modulation, const float *bend, const float *richness, const float *modMix, bool ramped, int numSamples)
+{
+    _chunkModulation = modulation;
+    _chunkBend = bend;
+    _chunkRichness = richness;
+    _chunkModMix = modMix;
+    _chunkRamped = ramped;
+    _chunkModThru = ramped || !juce::exactlyEqual(modMix[0], 0.0f);
+
+    // Only share the work out when there are enough voices to pay for it
+    if (_renderPool.getNumThreads() > 0 && _numActiveVoices >= _threadingThreshold.load())
+        _renderPool.render(*this, _numActiveVoices, VOICEGROUP, out, numSamples);
+    else
+        renderVoiceRange(0, _numActiveVoices, out, numSamples);
+}
+
+// Renders voices [firstVoice, endVoice) into out. This can run on a render pool
+// worker, so it must only touch those voice slots and the chunk inputs.
+void DX10AudioProcessor::renderVoiceRange(int firstVoice, int endVoice, float *out, int numSamples)
+{
+    if (_chunkRamped) renderVoiceKernel<true, true>(firstVoice, endVoice, out, numSamples);
+    else if (_chunkModThru) renderVoiceKernel<true, false>(firstVoice, endVoice, out, numSamples);
+    else renderVoiceKernel<false, false>(firstVoice, endVoice, out, numSamples);
+}
+
+// The voice loop, specialized at compile time. Without ModThru the mod1 term
+// is left out of the output. That only applies when Mod Thru is exactly 0,
+// as in Bright E.Piano, Jazz E.Piano, Harp, Steel Drum, Trumpet and Reed 2.
+// Small settings such as Log Drum's and Sine Bass's still take the ModThru
+// kernel, since the term is left out exactly, not below a threshold. Without Ramped, pitch bend, Waveform and
+// Mod Thru are constant for the chunk, so they are read once instead of
+// every sample.
+template <bool ModThru, bool Ramped>
+void DX10AudioProcessor::renderVoiceKernel(int firstVoice, int endVoice, float *out, int numSamples)
+{
+    const float *modulation = _chunkModulation, *bend = _chunkBend, *richness = _chunkRichness, *modMix = _chunkModMix;
+    juce::FloatVectorOperations::clear(out, numSamples);
+
+   #if JUCE_USE_SIMD
+    using Vec = juce::dsp::SIMDRegister<float>;
+    constexpr int width = (int) Vec::SIMDNumElements;
+    static_assert(NSLOTS % width == 0, "NSLOTS must be a multiple of the SIMD width");
+    static_assert(VOICEGROUP % width == 0, "render pool ranges must hold whole SIMD groups");
+
+    const auto silence = Vec::expand(SILENCE);
+    const auto one = Vec::expand(1.0f);
+    const auto minusOne = Vec::expand(-1.0f);
+    const auto two = Vec::expand(2.0f);
+    const auto fixedRichness = Vec::expand(richness[0]), fixedModMix = Vec::expand(modMix[0]);
+    const auto fixedBend = Vec::expand(bend[0]);
+
+    // The last group may run past endVoice, but only when endVoice is
+    // _numActiveVoices, and those slots are always silent and get masked out
+    // like any other finished voice.
+    for (int v = firstVoice; v < endVoice; v += width) {
+        auto env = Vec::fromRawArray(_voices.env + v);
+        if (Vec::greaterThan(env, silence).sum() == 0) continue;  // whole group is silent
+
+        auto cenv = Vec::fromRawArray(_voices.cenv + v);
+        auto car = Vec::fromRawArray(_voices.car + v);
+        auto mod0 = Vec::fromRawArray(_voices.mod0 + v);
+        auto mod1 = Vec::fromRawArray(_voices.mod1 + v);
+        auto menv = Vec::fromRawArray(_voices.menv + v);
+        const auto dcar = Vec::fromRawArray(_voices.dcar + v);
+        const auto dmod = Vec::fromRawArray(_voices.dmod + v);
+        const auto catt = Vec::fromRawArray(_voices.catt + v);
+        const auto cdec = Vec::fromRawArray(_voices.cdec + v);
+        const auto mlev = Vec::fromRawArray(_voices.mlev + v);
+        const auto mdec = Vec::fromRawArray(_voices.mdec + v);
+        const auto fixedDcar = dcar * fixedBend;
+
+        for (int i = 0; i < numSamples; ++i) {
+            const auto active = Vec::greaterThan(env, silence);
+            const auto e = env;
+            env = ((e * cdec) & active) | (e & ~active);
+            cenv += catt * (e - cenv);
+            const auto y = dmod * mod0 - mod1; mod1 = mod0; mod0 = y;
+            menv += mdec * (mlev - menv);
+            auto x = car + (Ramped ? dcar * Vec::expand(bend[i]) : fixedDcar) + y * menv + Vec::expand(modulation[i]);
+            for (auto wrap = Vec::greaterThan(x, one); wrap.sum() != 0; wrap = Vec::greaterThan(x, one)) x -= two & wrap;
+            for (auto wrap = Vec::lessThan(x, minusOne); wrap.sum() != 0; wrap = Vec::lessThan(x, minusOne)) x += two & wrap;
+            car = x;
+            const auto r = Ramped ? Vec::expand(richness[i]) : fixedRichness;
+            const auto s = x + x * x * x * (r * x * x - one - r);
+            if constexpr (ModThru) out[i] += ((cenv * ((Ramped ? Vec::expand(modMix[i]) : fixedModMix) * mod1 + s)) & active).sum();
+            else out[i] += ((cenv * s) & active).sum();
+        }
 
-    // Push audio to spectrum analyzer
-    if (spectrumAnalyzer != nullptr)
-        spectrumAnalyzer->pushBuffer(buffer);
+        env.copyToRawArray(_voices.env + v);
+        cenv.copyToRawArray(_voices.cenv + v);
+        car.copyToRawArray(_voices.car + v);
+        mod0.copyToRawArray(_voices.mod0 + v);
+        mod1.copyToRawArray(_voices.mod1 + v);
+        menv.copyToRawArray(_voices.menv + v);
+    }
+   #else
+    for (int v = firstVoice; v < endVoice; ++v) {
+        for (int i = 0; i < numSamples; ++i) {
+            float e = _voices.env[v];
+            if (e <= SILENCE) break;
+            _voices.env[v] = e * _voices.cdec[v];
+            _voices.cenv[v] += _voices.catt[v] * (e - _voices.cenv[v]);
+            float y = _voices.dmod[v] * _voices.mod0[v] - _voices.mod1[v]; _voices.mod1[v] = _voices.mod0[v]; _voices.mod0[v] = y;
+            _voices.menv[v] += _voices.mdec[v] * (_voices.mlev[v] - _voices.menv[v]);
+            float x = _voices.car[v] + _voices.dcar[v] * bend[Ramped ? i : 0] + y * _voices.menv[v] + modulation[i];
+            while (x > 1.0f) x -= 2.0f; while (x < -1.0f) x += 2.0f;
+            _voices.car[v] = x;
+            const float r = richness[Ramped ? i : 0];
+            float s = x + x * x * x * (r * x * x - 1.0f - r);
+            if constexpr (ModThru) out[i] += _voices.cenv[v] * (modMix[Ramped ? i : 0] * _voices.mod1[v] + s);
+            else out[i] += _voices.cenv[v] * s;
+        }
+    }
+   #endif
 }
 
 void DX10AudioProcessor::noteOn(int note, int velocity)
 {
     if (velocity > 0) {
-        float l = 1.0f; int vl = 0;
-        for (int v = 0; v < NVOICES; v++) { if (_voices[v].env < l) { l = _voices[v].env; vl = v; } }
+        int vl;
+        const int victim = _allocator.getNumPlaying() < _polyphony ? -1 : _allocator.findVictim(_stealPolicy, _voices.env);
+        if (victim >= 0 && _numActiveVoices < NSLOTS) {
+            // Fade the stolen voice out quickly and start the new note in a free slot
+            _voices.cdec[victim] = _stealFade; _voices.env[victim] = _voices.cenv[victim]; _voices.catt[victim] = 1.0f;
+            _voices.mlev[victim] = 0.0f; _voices.mdec[victim] = 1.0f - _stealFade;
+            _allocator.setKey(victim, _allocator.STOLEN);
+            vl = _numActiveVoices++;
+        } else if (victim >= 0 || _numActiveVoices == NSLOTS) {
+            // No room to fade: cut off the victim, or a voice that is already fading
+            vl = victim >= 0 ? victim : _allocator.firstWithKey(_allocator.STOLEN);
+            _allocator.remove(vl);
+        } else {
+            vl = _numActiveVoices++;  // take the first free slot
+        }
+        _allocator.add(vl, note);
         float p = std::exp(0.05776226505f * (float(note) + _fineTune));
-        _voices[vl].note = note;
-        _voices[vl].car = 0.0f;
-        _voices[vl].dcar = _tune * _pitchBend * p;
+        _voices.car[vl] = 0.0f;
+        _voices.dcar[vl] = _tune * p;
         if (p > 50.0f) p = 50.0f;
         p *= (64.0f + _velocitySensitivity * (velocity - 64));
-        _voices[vl].menv = _modInitialLevel * p;
-        _voices[vl].mlev = _modSustain * p;
-        _voices[vl].mdec = _modDecay;
-        _voices[vl].dmod = _ratio * _voices[vl].dcar;
-        _voices[vl].mod0 = 0.0f;
-        _voices[vl].mod1 = std::sin(_voices[vl].dmod);
-        _voices[vl].dmod = 2.0f * std::cos(_voices[vl].dmod);
-        float param13 = apvts.getRawParameterValue("Waveform")->load();
-        _voices[vl].env = (1.5f - param13) * _volume * (velocity + 10);
-        _voices[vl].cdec = _decay;
-        _voices[vl].catt = _attack;
-        _voices[vl].cenv = 0.0f;
+        _voices.menv[vl] = _modInitialLevel * p;
+        _voices.mlev[vl] = _modSustain * p;
+        _voices.mdec[vl] = _modDecay;
+        _voices.wmod[vl] = _ratio * _voices.dcar[vl];
+        _voices.mod0[vl] = 0.0f;
+        _voices.mod1[vl] = std::sin(_voices.wmod[vl] * _modulatorBend);
+        _voices.dmod[vl] = 2.0f * std::cos(_voices.wmod[vl] * _modulatorBend);
+        _voices.env[vl] = (1.5f - _waveform) * _volume * (velocity + 10);
+        _voices.cdec[vl] = _decay;
+        _voices.catt[vl] = _attack;
+        _voices.cenv[vl] = 0.0f;
     } else {
-        for (int v = 0; v < NVOICES; v++) {
-            if (_voices[v].note == note) {
-                if (_sustain == 0) { _voices[v].cdec = _release; _voices[v].env = _voices[v].cenv; _voices[v].catt = 1.0f; _voices[v].mlev = 0.0f; _voices[v].mdec = _modRelease; }
-                else { _voices[v].note = SUSTAIN; }
+        for (int v = _allocator.firstWithKey(note); v >= 0; ) {
+            const int next = _allocator.nextWithSameKey(v);
+            if (_sustain == 0) releaseVoice(v);
+            else _allocator.setKey(v, _allocator.SUSTAINED);
+            v = next;
+        }
+    }
+}
+
+void DX10AudioProcessor::releaseVoice(int v)
+{
+    _voices.cdec[v] = _release; _voices.env[v] = _voices.cenv[v]; _voices.catt[v] = 1.0f; _voices.mlev[v] = 0.0f; _voices.mdec[v] = _modRelease;
+    _allocator.setKey(v, _allocator.RELEASED);
+}
+
+// The sustain pedal went up: every voice it was holding starts its release.
+void DX10AudioProcessor::releaseSustainedVoices()
+{
+    while (_allocator.firstWithKey(_allocator.SUSTAINED) >= 0) releaseVoice(_allocator.firstWithKey(_allocator.SUSTAINED));
+}
+
+// Changes the angle per sample of voice v's modulator. The sine recursion
+// only stores the last two outputs, so the older one is recomputed for the new
+// frequency. That keeps the phase and amplitude where they were, and the
+// modulator doesn't click.
+static void setModulatorAngle(VoiceBank &voices, int v, float oldAngle, float newAngle)
+{
+    const float oldSin = std::sin(oldAngle), newSin = std::sin(newAngle), newCos = std::cos(newAngle);
+    const float y1 = voices.mod0[v], y0 = voices.mod1[v];
+    if (std::abs(oldSin) > 1.0e-6f) voices.mod1[v] = y1 * newCos - (y1 * 0.5f * voices.dmod[v] - y0) / oldSin * newSin;
+    voices.dmod[v] = 2.0f * newCos;
+}
+
+// Moves the modulator of every active voice to a new pitch bend.
+void DX10AudioProcessor::retuneModulators(float bend)
+{
+    for (int v = 0; v < _numActiveVoices; ++v)
+        setModulatorAngle(_voices, v, _voices.wmod[v] * _modulatorBend, _voices.wmod[v] * bend);
+    _modulatorBend = bend;
+}
+
+// Carries the active voices over to a new render rate; ratio is the old rate
+// over the new one. Per-sample increments are scaled by it, and per-sample
+// envelope multipliers and smoothing coefficients are raised to its power, so
+// pitch, phase, levels and envelope times all stay where they were.
+void DX10AudioProcessor::rescaleVoices(float ratio)
+{
+    if (juce::exactlyEqual(ratio, 1.0f)) return;
+    for (int v = 0; v < _numActiveVoices; ++v) {
+        _voices.dcar[v] *= ratio;
+        const float wmod = _voices.wmod[v] * ratio;
+        setModulatorAngle(_voices, v, _voices.wmod[v] * _modulatorBend, wmod * _modulatorBend);
+        _voices.wmod[v] = wmod;
+        _voices.cdec[v] = std::pow(_voices.cdec[v], ratio);
+        _voices.catt[v] = 1.0f - std::pow(1.0f - _voices.catt[v], ratio);
+        _voices.mdec[v] = 1.0f - std::pow(1.0f - _voices.mdec[v], ratio);
+    }
+}
+
+// Called at the end of every block. Voices that have gone silent are removed
+// by moving the last active voice into their slot, which keeps the active
+// voices packed at the start of the voice bank.
+void DX10AudioProcessor::removeFinishedVoices()
+{
+    for (int v = 0; v < _numActiveVoices; ) {
+        if (_voices.env[v] < SILENCE) {
+            const int last = --_numActiveVoices;
+            _allocator.remove(v);
+            if (v != last) {
+                _allocator.move(last, v);
+                _voices.car[v] = _voices.car[last];   _voices.dcar[v] = _voices.dcar[last];
+                _voices.wmod[v] = _voices.wmod[last]; _voices.dmod[v] = _voices.dmod[last]; _voices.mod0[v] = _voices.mod0[last]; _voices.mod1[v] = _voices.mod1[last];
+                _voices.env[v] = _voices.env[last];   _voices.cenv[v] = _voices.cenv[last];
+                _voices.catt[v] = _voices.catt[last]; _voices.cdec[v] = _voices.cdec[last];
+                _voices.menv[v] = _voices.menv[last]; _voices.mlev[v] = _voices.mlev[last]; _voices.mdec[v] = _voices.mdec[last];
             }
+            _voices.env[last] = 0.0f; _voices.cenv[last] = 0.0f; _voices.menv[last] = 0.0f; _voices.mlev[last] = 0.0f;
+            continue;  // slot v now holds a different voice, check it too
         }
+        if (_voices.menv[v] < SILENCE) { _voices.menv[v] = 0.0f; _voices.mlev[v] = 0.0f; }
+        ++v;
     }
+    _allocator.invalidateOrder();
 }
 
 juce::AudioProcessorEditor *DX10AudioProcessor::createEditor() { return new DX10AudioProcessorEditor(*this); }
 
-void DX10AudioProcessor::getStateInformation(juce::MemoryBlock &destData) { copyXmlToBinary(*apvts.copyState().createXml(), destData); }
+void DX10AudioProcessor::getStateInformation(juce::MemoryBlock &destData)
+{
+    // Per-instance options are stored as attributes next to the parameters
+    auto state = apvts.copyState();
+    state.setProperty("smoothAutomation", getSmoothAutomation(), nullptr);
+    state.setProperty("oversampling", getOversamplingFactorIndex(), nullptr);
+    state.setProperty("oversamplingLinearPhase", getOversamplingLinearPhase(), nullptr);
+    state.setProperty("offlineQuality", getOfflineQuality(), nullptr);
+    state.setProperty("stealPolicy", int(getStealPolicy()), nullptr);
+    state.setProperty("renderThreads", getRenderThreads(), nullptr);
+    state.setProperty("threadingThreshold", getThreadingThreshold(), nullptr);
+    state.setProperty("saveTelemetryOnUnload", getSaveTelemetryOnUnload(), nullptr);
+    state.setProperty("analyzerFftOrder", _analyzerFeed.getFftOrder(), nullptr);
+    state.setProperty("analyzerOverlap", _analyzerFeed.getOverlap(), nullptr);
+    copyXmlToBinary(*state.createXml(), destData);
+}
 
 void DX10AudioProcessor::setStateInformation(const void *data, int sizeInBytes)
 {
@@ -322,6 +866,15 @@ void DX10AudioProcessor::setStateInformation(const void *data, int sizeInBytes)
     if (xml.get() != nullptr && xml->hasTagName(apvts.state.getType())) {
         _isRestoringState = true;
         apvts.replaceState(juce::ValueTree::fromXml(*xml));
+        setSmoothAutomation(xml->getBoolAttribute("smoothAutomation", false));
+        setOversampling(xml->getIntAttribute("oversampling", 0), xml->getBoolAttribute("oversamplingLinearPhase", false));
+        setOfflineQuality(xml->getBoolAttribute("offlineQuality", true));
+        setStealPolicy(StealPolicy(juce::jlimit(0, int(VoiceAllocator<NSLOTS>::NUMSTEALPOLICIES) - 1, xml->getIntAttribute("stealPolicy", 0))));
+        setRenderThreads(xml->getIntAttribute("renderThreads", 0));
+        setThreadingThreshold(xml->getIntAttribute("threadingThreshold", 32));
+        setSaveTelemetryOnUnload(xml->getBoolAttribute("saveTelemetryOnUnload", false));
+        _analyzerFeed.setFftOrder(xml->getIntAttribute("analyzerFftOrder", 11));
+        _analyzerFeed.setOverlap(xml->getIntAttribute("analyzerOverlap", 1));
         if (auto* param = apvts.getRawParameterValue("PresetIndex"))
             _currentProgram = static_cast<int>(param->load() * (NPRESETS - 1) + 0.5f);
         _isRestoringState = false;
@@ -353,6 +906,9 @@ juce::AudioProcessorValueTreeState::ParameterLayout DX10AudioProcessor::createPa
     // Hidden parameter to track selected preset ID for undo (1-32 = factory, 1001+ = user)
     // Default to 16 = Log Drum preset
     layout.add(std::make_unique<juce::AudioParameterInt>(juce::ParameterID("SelectedPresetId", 1), "SelectedPresetId", 1, 999999, 16));
+    // Added after the first release: appended, so the parameters before it
+    // keep their indices, and with version hint 2 so AU hosts see it as new
+    layout.add(std::make_unique<juce::AudioParameterInt>(juce::ParameterID("Polyphony", 2), "Polyphony", 1, NVOICES, DEFAULTVOICES, juce::AudioParameterIntAttributes().withLabel("voices")));
     return layout;
 }
 
@@ -1,9 +1,16 @@
 #pragma once
 
 #include "JuceHeader.h"
+#include "VoiceRenderPool.h"
+#include "MidiEventQueue.h"
+#include "VoiceAllocator.h"
+#include "BlockTelemetry.h"
+#include "AnalyzerFeed.h"
 
 const int NPARAMS = 16;       // number of parameters
-const int NVOICES = 8;        // max polyphony
+const int NVOICES = 128;      // max polyphony
+const int NSLOTS = NVOICES + 16;  // voice slots, with room for stolen voices to fade out
+const int DEFAULTVOICES = 8;  // default polyphony
 const int NPRESETS = 32;      // number of factory presets
 
 const float SILENCE = 0.0003f;  // voice choking
@@ -20,38 +27,38 @@ struct DX10Program
     float param[NPARAMS];
 };
 
-// State for an active voice.
-struct Voice
+// State for all the voices, stored as a structure of arrays: slot v of every
+// array belongs to voice v. This lets the render loop process several voices
+// with a single SIMD instruction. The sounding voices are always packed into
+// the first slots, so only those need to be visited.
+struct VoiceBank
 {
-    // What note triggered this voice, or SUSTAIN when the key is released
-    // but the sustain pedal is still held down. 0 if the voice is inactive.
-    int note;
-
     // Carrier oscillator
-    float car;   // current phase value
-    float dcar;  // phase increment
+    alignas(32) float car[NSLOTS];   // current phase value
+    alignas(32) float dcar[NSLOTS];  // phase increment before pitch bend
 
     // Modulator sine oscillator
-    float dmod;  // phase increment
-    float mod0;
-    float mod1;
+    alignas(32) float wmod[NSLOTS];  // angle per sample before pitch bend
+    alignas(32) float dmod[NSLOTS];  // 2 cos(angle per sample), with pitch bend
+    alignas(32) float mod0[NSLOTS];
+    alignas(32) float mod1[NSLOTS];
 
     // Carrier envelope
-    float env;   // current envelope level
-    float cenv;  // smoothed envelope that includes the attack portion
-    float catt;  // smoothing coefficient for attack
-    float cdec;  // decay mutiplier
+    alignas(32) float env[NSLOTS];   // current envelope level
+    alignas(32) float cenv[NSLOTS];  // smoothed envelope that includes the attack portion
+    alignas(32) float catt[NSLOTS];  // smoothing coefficient for attack
+    alignas(32) float cdec[NSLOTS];  // decay mutiplier
 
     // Modulator envelope
-    float menv;  // current envelope level
-    float mlev;  // target level
-    float mdec;  // decay multiplier
+    alignas(32) float menv[NSLOTS];  // current envelope level
+    alignas(32) float mlev[NSLOTS];  // target level
+    alignas(32) float mdec[NSLOTS];  // decay multiplier
 };
 
-// Forward declaration
-class SpectrumAnalyzer;
-
-class DX10AudioProcessor : public juce::AudioProcessor
+class DX10AudioProcessor : public juce::AudioProcessor,
+                           private juce::AudioProcessorParameter::Listener,
+                           private VoiceRenderPool::Client,
+                           private juce::AsyncUpdater
 {
 public:
     DX10AudioProcessor();
@@ -64,6 +71,8 @@ public:
     bool isBusesLayoutSupported(const BusesLayout &layouts) const override;
 
     void processBlock(juce::AudioBuffer<float> &, juce::MidiBuffer &) override;
+    void processBlock(juce::AudioBuffer<double> &, juce::MidiBuffer &) override;
+    bool supportsDoublePrecisionProcessing() const override { return true; }
 
     juce::AudioProcessorEditor *createEditor() override;
     bool hasEditor() const override { return true; }
@@ -73,7 +82,7 @@ public:
     bool acceptsMidi() const override { return true; }
     bool producesMidi() const override { return false; }
     bool isMidiEffect() const override { return false; }
-    double getTailLengthSeconds() const override { return 0.0; }
+    double getTailLengthSeconds() const override { return _tailLengthSeconds; }
 
     int getNumPrograms() override;
     int getCurrentProgram() override;
@@ -100,18 +109,113 @@ public:
     void setCurrentPresetName(const juce::String& name) { _currentPresetName = name; }
     juce::String getCurrentPresetName() const { return _currentPresetName; }
     
-    // Spectrum analyzer data access
-    void setSpectrumAnalyzer(SpectrumAnalyzer* analyzer) { spectrumAnalyzer = analyzer; }
+    // When on, automation of Waveform, Mod Thru, Gain and Saturation is ramped
+    // per sample instead of jumping at the start of each block.
+    void setSmoothAutomation(bool shouldSmooth) { _smoothAutomation = shouldSmooth; }
+    bool getSmoothAutomation() const { return _smoothAutomation; }
+
+    // Oversampling for the waveshaper and saturation: factor index 0-3 selects
+    // 1x, 2x, 4x or 8x, with polyphase IIR or linear phase FIR filters. Call
+    // from the message thread; the latency reported to the host follows.
+    void setOversampling(int factorIndex, bool linearPhase);
+    int getOversamplingFactorIndex() const { return _oversamplingFactorIndex; }
+    bool getOversamplingLinearPhase() const { return _oversamplingLinearPhase; }
+
+    // When on, offline renders (isNonRealtime()) use at least 4x oversampling,
+    // a per-sample LFO, smoothed automation and larger render chunks. Live
+    // playback keeps the settings above.
+    void setOfflineQuality(bool shouldBoost);
+    bool getOfflineQuality() const { return _offlineQuality; }
+    void setNonRealtime(bool isNonRealtime) noexcept override;
+
+    // Multi-threaded voice rendering: the number of worker threads that help
+    // the audio thread (0 is off), and the number of active voices below which
+    // the voices are still rendered on the audio thread alone. Call from the
+    // message thread.
+    void setRenderThreads(int numThreads) { _renderPool.setNumThreads(numThreads); }
+    int getRenderThreads() const { return _renderPool.getNumThreads(); }
+    void setThreadingThreshold(int numVoices) { _threadingThreshold = juce::jlimit(1, NVOICES, numVoices); }
+    int getThreadingThreshold() const { return _threadingThreshold; }
+
+    // Which voice a note takes when all voices are busy. Stolen voices fade
+    // out over a few milliseconds instead of being cut off.
+    using StealPolicy = VoiceAllocator<NSLOTS>::StealPolicy;
+    void setStealPolicy(StealPolicy policy) { _stealPolicy = policy; }
+    StealPolicy getStealPolicy() const { return _stealPolicy; }
+
+    // Number of MIDI events dropped so far because a block had more events
+    // than the event queue holds.
+    uint32_t getMidiOverflowCount() const { return _events.getOverflowCount(); }
+
+    // Cost of processBlock() for the editor's load meter, as a proportion of
+    // the time the block lasts. Safe to call from any thread.
+    // getDspLoad() is smoothed over recent blocks. takePeakDspLoad() returns
+    // the highest single block since the previous call and starts over.
+    // getNumBlocksOverBudget() counts blocks that used more than HIGHLOAD of
+    // their time, which is when a busier moment is likely to cause a dropout.
+    static constexpr float HIGHLOAD = 0.7f;
+    float getDspLoad() const { return float(_loadMeasurer.getLoadAsProportion()); }
+    float takePeakDspLoad() { return _peakLoad.exchange(0.0f); }
+    uint32_t getNumBlocks() const { return _numBlocks.load(std::memory_order_relaxed); }
+    uint32_t getNumBlocksOverBudget() const { return _numBlocksOverBudget.load(std::memory_order_relaxed); }
+    int getNumActiveVoices() const { return _numActiveVoicesForDisplay.load(std::memory_order_relaxed); }
+
+    // Histograms and a log of recent blocks, for tail-latency statistics.
+    // When saving on unload is on, the destructor writes them as JSON to
+    // getTelemetryDirectory().
+    const BlockTelemetry &getTelemetry() const { return _telemetry; }
+    void setSaveTelemetryOnUnload(bool shouldSave) { _saveTelemetryOnUnload = shouldSave; }
+    bool getSaveTelemetryOnUnload() const { return _saveTelemetryOnUnload; }
+    static juce::File getTelemetryDirectory();
+
+    // Spectra of the output for the editor's analyzer, computed on a
+    // background thread while the analyzer is showing.
+    AnalyzerFeed &getAnalyzerFeed() { return _analyzerFeed; }
 
 private:
     juce::AudioProcessorValueTreeState::ParameterLayout createParameterLayout();
 
+    // The parameters used by the DSP code. The first NPARAMS are in the same
+    // order as DX10Program::param.
+    enum DSPParam
+    {
+        Attack, Decay, Release, Coarse, Fine, ModInit, ModDec, ModSus, ModRel, ModVel,
+        Vibrato, Octave, FineTune, Waveform, ModThru, LFORate, Gain, Saturation, Polyphony,
+        NUMDSPPARAMS
+    };
+    static_assert(NUMDSPPARAMS <= 32, "the dirty mask holds one bit per parameter");
+
+    void parameterValueChanged(int parameterIndex, float newValue) override;
+    void parameterGestureChanged(int, bool) override {}
+
     void update();
+    void startPendingRamps();
     void resetState();
 
     void createPrograms();
+    template <typename SampleType>
+    void processBlockImpl(juce::AudioBuffer<SampleType> &buffer, juce::MidiBuffer &midiMessages);
     void processEvents(juce::MidiBuffer &midiMessages);
+    void handleEvent(const MidiEvent &event);
     void noteOn(int note, int velocity);
+    void releaseVoice(int v);
+    void releaseSustainedVoices();
+    void renderBlock(float *out, int startFrame, int numFrames, int &event);
+    void renderVoices(float *out, const float *modulation, const float *bend, const float *richness, const float *modMix, bool ramped, int numSamples);
+    template <bool ModThru, bool Ramped>
+    void renderVoiceKernel(int firstVoice, int endVoice, float *out, int numSamples);
+    void retuneModulators(float bend);
+    void rescaleVoices(float ratio);
+    void renderVoiceRange(int firstVoice, int endVoice, float *out, int numSamples) override;
+    void applyOutputStage(float *data, int numSamples);
+    void setRenderSampleRate(double sampleRate);
+    void updateOversampling();
+    int getEffectiveOversamplingFactorIndex() const;
+    void reportLatency();
+    void updateTailLength();
+    void handleAsyncUpdate() override;
+    void removeFinishedVoices();
+    void measureLoad(juce::int64 startTicks, int numSamples, int numEvents);
 
     // The factory presets.
     std::vector<DX10Program> _programs;
@@ -122,30 +226,92 @@ private:
     // Current preset name (for display, especially for user presets)
     juce::String _currentPresetName;
 
-    // The current sample rate and 1 / sample rate.
+    // The rate the voices are rendered at and 1 / that rate. This is the host
+    // sample rate times the oversampling factor.
     float _sampleRate, _inverseSampleRate;
 
-    // MIDI note on / note off events for the current block. Each event is
-    // described by 3 values: delta time, note number, velocity.
-    static const int EVENTBUFFER = 120;
-    int _notes[EVENTBUFFER + 8];
+    // The sample rate and maximum block size given to prepareToPlay().
+    double _hostSampleRate = 44100.0;
+    int _maxBlockSize = 512;
+
+    // Float scratch space for one slice of a double-precision block.
+    std::vector<float> _renderBuffer;
+
+    // === Oversampling ===
+
+    // One oversampler for every factor above 1x, for both filter types. They
+    // are all created in the constructor and sized in prepareToPlay(), so
+    // switching never allocates and the message thread can always read them.
+    static const int NOVERSAMPLING = 4;  // 1x, 2x, 4x, 8x
+    std::unique_ptr<juce::dsp::Oversampling<float>> _oversamplers[2][NOVERSAMPLING - 1];
+
+    // Requested settings, written by the message thread.
+    std::atomic<int> _oversamplingFactorIndex { 0 };
+    std::atomic<bool> _oversamplingLinearPhase { false };
+
+    // Offline renders use at least this factor index (4x) when _offlineQuality is on.
+    static const int OFFLINEOVERSAMPLING = 2;
+    std::atomic<bool> _offlineQuality { true };
+
+    // True while the current block is rendered in offline quality.
+    bool _offline = false;
+
+    // Settings in use on the audio thread. _oversampler is null at 1x.
+    int _activeOversampling = -1;
+    int _oversamplingFactor = 1;
+    juce::dsp::Oversampling<float> *_oversampler = nullptr;
+
+    // Host samples to keep running the oversampler for after the last voice
+    // ends, so its filters' tail comes out, and how many it is reset to
+    // while voices sound.
+    int _oversamplerTail = 0, _oversamplerTailLength = 0;
+
+    // MIDI events for the current block, handled at their sample positions
+    // while rendering.
+    MidiEventQueue _events;
+
+    // State of all the voices.
+    VoiceBank _voices {};
 
-    // Special event code that marks the end of the MIDI events list.
-    const int EVENTS_DONE = 99999999;
+    // Which note every active voice belongs to, and the order to steal them in.
+    VoiceAllocator<NSLOTS> _allocator;
+    std::atomic<StealPolicy> _stealPolicy { VoiceAllocator<NSLOTS>::StealQuietest };
 
-    // Special "note number" that says this voice is now kept alive by the
-    // sustain pedal being pressed down. As soon as the pedal is released,
-    // this voice will fade out.
-    const int SUSTAIN = 128;
+    // Envelope multiplier for a voice that is being stolen (about 5 ms to silence).
+    float _stealFade = 0.963f;
 
-    // List of the active voices.
-    Voice _voices[NVOICES] = { 0 };
+    // The voices are rendered in chunks of at most this many samples, so the
+    // per-sample LFO values fit in a small buffer on the stack. Offline renders
+    // use bigger chunks, which means fewer passes over the voice bank and fewer
+    // hand-offs to the render pool.
+    static const int RENDERCHUNK = 256;
+    static const int OFFLINECHUNK = 1024;
 
-    // How many voices are currently in use.
+    // How many voices are currently in use. These are always the voices in
+    // slots 0 to _numActiveVoices - 1; every slot after that is silent.
     int _numActiveVoices;
 
-    // The LFO only updates every 100 samples. This counter keeps track of when
-    // the next update is.
+    // Maximum number of voices that may sound at once (Polyphony parameter).
+    int _polyphony = DEFAULTVOICES;
+
+    // === Multi-threaded rendering ===
+
+    // Worker threads that render part of the voices for each chunk. Ranges
+    // are handed out in whole groups of VOICEGROUP voices.
+    static const int VOICEGROUP = 8;
+    VoiceRenderPool _renderPool { OFFLINECHUNK };
+    std::atomic<int> _threadingThreshold { 32 };
+
+    // Per-sample inputs of the chunk being rendered, shared with the workers.
+    const float *_chunkModulation = nullptr, *_chunkBend = nullptr, *_chunkRichness = nullptr, *_chunkModMix = nullptr;
+
+    // Which render kernel the chunk uses: whether any of the inputs above is
+    // ramping, and whether the Mod Thru term is needed at all.
+    bool _chunkRamped = false, _chunkModThru = true;
+
+    // The LFO only updates every LFOINTERVAL + 1 samples (every sample in
+    // offline quality). This counter keeps track of when the next update is.
+    static const int LFOINTERVAL = 100;
     int _lfoStep;
 
     // Used by the LFO to approximate a sine wave.
@@ -158,6 +324,17 @@ private:
 
     // === Parameter values ===
 
+    // Raw parameter values, looked up once in the constructor so that the
+    // audio thread never has to search for a parameter by name.
+    std::atomic<float> *_params[NUMDSPPARAMS];
+
+    // Maps the host index of a parameter to its DSPParam, or -1.
+    std::vector<int> _hostIndexToParam;
+
+    // One bit per DSPParam that has changed since the last call to update().
+    // Set by the parameter listener, which may run on any thread.
+    std::atomic<uint32_t> _dirtyParams { ~0u };
+
     // Tuning: number of octaves up or down.
     float _tune;
 
@@ -176,6 +353,9 @@ private:
     // Velocity sensitivity for the modulator envelope (for brightness).
     float _velocitySensitivity;
 
+    // Raw value of the Waveform parameter, which also sets the note level.
+    float _waveform;
+
     // The amount of vibrato to apply.
     float _vibrato;
 
@@ -203,16 +383,63 @@ private:
 
     // Pitch bend value.
     float _pitchBend;
+
+    // Pitch bend acts on the voices that are sounding. The carriers follow
+    // this ramp every sample. The modulators are retuned to _modulatorBend
+    // every BENDINTERVAL render samples, counted from prepareToPlay(), while
+    // the two differ.
+    juce::SmoothedValue<float> _bendRamp;
+    float _modulatorBend = 1.0f;
+    static const int BENDINTERVAL = 32;
+    static constexpr double BENDSMOOTHINGTIME = 0.005;
     
     // Output section parameters
     float _outputGain = 1.0f;  // 0dB default
     float _saturation = 0.0f;
+
+    // Per-sample ramps towards _richness, _modMix, _outputGain and _saturation.
+    // These act on voices that are already sounding, so they would zipper if
+    // they only changed once per block.
+    // Off by default, so existing sessions sound as they did; offline
+    // quality renders always smooth.
+    juce::SmoothedValue<float> _richnessRamp, _modMixRamp, _gainRamp, _saturationRamp;
+    std::atomic<bool> _smoothAutomation { false };
+
+    // When smoothing, a changed parameter's ramp only starts at the next
+    // multiple of AUTOMATIONINTERVAL host samples since prepareToPlay(). The
+    // host still hands over parameter values once per block, so this can't
+    // make the output independent of the block size; it only keeps the ramp
+    // start from moving within the block a change arrives in. _pendingRamps
+    // holds the DSPParam bits of the ramps waiting for that point.
+    static const int AUTOMATIONINTERVAL = 32;
+    juce::int64 _hostPosition = 0;
+    uint32_t _pendingRamps = 0;
+
+    // How long a released note takes to fall below SILENCE, from the Release
+    // setting, and the tail reported to the host, which adds the oversampling
+    // filters' latency and ringing. The host reads it from any thread.
+    double _releaseTailSeconds = 0.0;
+    std::atomic<double> _tailLengthSeconds { 0.0 };
+
+    // === Load measurement ===
+
+    // Written at the end of every block and read by the editor.
+    juce::AudioProcessLoadMeasurer _loadMeasurer;
+    std::atomic<float> _peakLoad { 0.0f };
+    std::atomic<uint32_t> _numBlocks { 0 }, _numBlocksOverBudget { 0 };
+    std::atomic<int> _numActiveVoicesForDisplay { 0 };
+    BlockTelemetry _telemetry;
+    std::atomic<bool> _saveTelemetryOnUnload { false };
+
+    // Length of the parameter ramps in seconds.
+    static constexpr double SMOOTHINGTIME = 0.02;
     
     // Flag to prevent setCurrentProgram from overwriting restored state
     bool _isRestoringState = false;
-    
-    // Pointer to spectrum analyzer (set by editor)
-    SpectrumAnalyzer* spectrumAnalyzer = nullptr;
+
+    // Output samples on their way to the spectrum analyzer. The audio thread
+    // only copies into its ring.
+    AnalyzerFeed _analyzerFeed;
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(DX10AudioProcessor)
 };
@@ -123,6 +123,19 @@ public:
     }
 
     bool loadPresetFromFile(const juce::File& file)
+    {
+        if (!applyPresetFile(valueTreeState, file, true))
+            return false;
+        
+        setLastLoadedPreset(file.getFullPathName());
+        
+        return true;
+    }
+    
+    // Sets the parameters stored in a preset file without touching the preset
+    // folder settings, so it can be used without a PresetManager (e.g. by the
+    // command-line tools).
+    static bool applyPresetFile(juce::AudioProcessorValueTreeState& valueTreeState, const juce::File& file, bool beginUndoTransaction)
     {
         if (!file.existsAsFile())
             return false;
@@ -135,7 +148,7 @@ public:
             return false;
         
         // Begin undo transaction for preset load
-        if (auto* undoManager = valueTreeState.undoManager)
+        if (auto* undoManager = valueTreeState.undoManager; undoManager != nullptr && beginUndoTransaction)
             undoManager->beginNewTransaction("Load Preset: " + file.getFileNameWithoutExtension());
         
         auto newState = juce::ValueTree::fromXml(*xml);
@@ -157,8 +170,6 @@ public:
             }
         }
         
-        setLastLoadedPreset(file.getFullPathName());
-        
         return true;
     }
     
@@ -0,0 +1,151 @@
+#pragma once
+
+#include "JuceHeader.h"
+#include <array>
+#include <cmath>
+#include <vector>
+
+// A scrolling spectrogram: time runs left to right, frequency bottom to top
+// on the same logarithmic scale as the SpectrumAnalyzer, and level is shown
+// through a colour lookup table.
+//
+// The history lives in an image used as a ring of columns. Every new spectrum
+// writes exactly one column, and paint() draws the ring in two pieces, oldest
+// first, so adding a frame costs O(height) and the history is never redrawn.
+class Spectrogram : public juce::Component
+{
+public:
+    Spectrogram()
+    {
+        setOpaque(true);
+        buildColourTable();
+    }
+
+    // Adds a spectrum (linear magnitudes, numBins of them) as the newest
+    // column. Message thread only.
+    void addFrame(const float* spectrum, int numBins)
+    {
+        if (!history.isValid() || numBins <= 0) return;
+
+        const int height = history.getHeight();
+        if (numBins != rowBins) buildRowRanges(numBins);
+
+        {
+            juce::Image::BitmapData column(history, writeColumn, 0, 1, height, juce::Image::BitmapData::writeOnly);
+            for (int y = 0; y < height; ++y)
+            {
+                // Row 0 is the top of the image, so the highest frequencies
+                const int row = height - 1 - y;
+                const float level = juce::FloatVectorOperations::findMaximum(spectrum + rowStart[size_t(row)], rowEnd[size_t(row)] - rowStart[size_t(row)]);
+                column.setPixelColour(0, y, colourTable[size_t(getColourIndex(level))]);
+            }
+        }
+        writeColumn = (writeColumn + 1) % history.getWidth();
+
+        repaint(getHistoryBounds());
+    }
+
+    void paint(juce::Graphics& g) override
+    {
+        auto bounds = getLocalBounds().toFloat();
+
+        // The component is opaque, so the corners outside the rounded
+        // rectangle get the editor's background colour
+        g.fillAll(juce::Colour(0xFF0A0A10));
+
+        // Background
+        g.setColour(juce::Colour(0xFF0D0D12));
+        g.fillRoundedRectangle(bounds, 6.0f);
+
+        // History, oldest column at the left
+        if (history.isValid())
+        {
+            const auto area = getHistoryBounds();
+            const int width = history.getWidth(), height = history.getHeight();
+            const int oldestWidth = width - writeColumn;
+            g.drawImage(history, area.getX(), area.getY(), oldestWidth, height, writeColumn, 0, oldestWidth, height);
+            if (writeColumn > 0)
+                g.drawImage(history, area.getX() + oldestWidth, area.getY(), writeColumn, height, 0, 0, writeColumn, height);
+        }
+
+        // Border
+        g.setColour(juce::Colour(0xFF2A2A35));
+        g.drawRoundedRectangle(bounds.reduced(0.5f), 6.0f, 1.0f);
+    }
+
+    void resized() override
+    {
+        // A new size starts a new history
+        const auto area = getHistoryBounds();
+        if (area.isEmpty())
+        {
+            history = {};
+            return;
+        }
+
+        history = juce::Image(juce::Image::RGB, area.getWidth(), area.getHeight(), false);
+        history.clear(history.getBounds(), colourTable[0]);
+        writeColumn = 0;
+        rowBins = 0;
+        rowStart.assign(size_t(area.getHeight()), 0);
+        rowEnd.assign(size_t(area.getHeight()), 1);
+    }
+
+private:
+    static constexpr int numColours = 256;
+    static constexpr float mindB = -100.0f, maxdB = 0.0f;
+
+    juce::Rectangle<int> getHistoryBounds() const
+    {
+        return getLocalBounds().reduced(4);
+    }
+
+    // Works out which FFT bins every row covers, using the same logarithmic
+    // frequency scale as the SpectrumAnalyzer. Each row maps on its own, so
+    // neighbouring low rows can share a bin. Row 0 is the lowest.
+    void buildRowRanges(int numBins)
+    {
+        const int height = history.getHeight();
+        auto binAt = [height, numBins](int row)
+        {
+            const float skewedProportion = 1.0f - std::pow(1.0f - float(row) / float(height), 0.2f);
+            return juce::jlimit(0, numBins - 1, int(std::floor(skewedProportion * float(numBins))));
+        };
+
+        for (int row = 0; row < height; ++row)
+        {
+            rowStart[size_t(row)] = binAt(row);
+            rowEnd[size_t(row)] = row + 1 < height ? juce::jmax(rowStart[size_t(row)] + 1, binAt(row + 1)) : numBins;
+        }
+        rowBins = numBins;
+    }
+
+    static int getColourIndex(float level)
+    {
+        const float dB = juce::Decibels::gainToDecibels(level, mindB);
+        return juce::jlimit(0, numColours - 1, int((dB - mindB) / (maxdB - mindB) * float(numColours - 1)));
+    }
+
+    // Near black through the accent colour to yellow and white
+    void buildColourTable()
+    {
+        juce::ColourGradient gradient(juce::Colour(0xFF0D0D12), 0.0f, 0.0f, juce::Colours::white, 1.0f, 0.0f, false);
+        gradient.addColour(0.35, juce::Colour(0xFF005A4A));
+        gradient.addColour(0.6, juce::Colour(0xFF00D4AA));
+        gradient.addColour(0.85, juce::Colour(0xFFE0D040));
+        for (int i = 0; i < numColours; ++i)
+            colourTable[size_t(i)] = gradient.getColourAtPosition(double(i) / double(numColours - 1));
+    }
+
+    std::array<juce::Colour, numColours> colourTable;
+
+    // Ring of columns; writeColumn is the next to be written, and so the oldest
+    juce::Image history;
+    int writeColumn = 0;
+
+    // Row r shows FFT bins rowStart[r] to rowEnd[r] - 1, for spectra of rowBins bins
+    std::vector<int> rowStart, rowEnd;
+    int rowBins = 0;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(Spectrogram)
+};
@@ -1,45 +1,40 @@
 #pragma once
 
 #include "JuceHeader.h"
+#include "AnalyzerFeed.h"
+#include <functional>
 
+// Draws the spectra computed by the processor's AnalyzerFeed. The feed only
+// runs while an analyzer exists.
 class SpectrumAnalyzer : public juce::Component,
                           private juce::Timer
 {
 public:
-    SpectrumAnalyzer()
-        : forwardFFT(fftOrder),
-          window(fftSize, juce::dsp::WindowingFunction<float>::hann)
+    explicit SpectrumAnalyzer(AnalyzerFeed& analyzerFeed)
+        : feed(analyzerFeed),
+          spectrum(size_t(AnalyzerFeed::MAXBINS), 0.0f)
     {
         setOpaque(true);
-        startTimerHz(30);
-        
-        // Initialize FFT data
-        std::fill(fftData.begin(), fftData.end(), 0.0f);
         std::fill(scopeData.begin(), scopeData.end(), 0.0f);
+        buildBinRanges();
+        feed.start();
+        startTimerHz(30);
     }
 
     ~SpectrumAnalyzer() override
     {
         stopTimer();
-    }
-
-    void pushBuffer(const juce::AudioBuffer<float>& buffer)
-    {
-        if (buffer.getNumChannels() > 0)
-        {
-            const auto* channelData = buffer.getReadPointer(0);
-            
-            for (int i = 0; i < buffer.getNumSamples(); ++i)
-            {
-                pushNextSampleIntoFifo(channelData[i]);
-            }
-        }
+        feed.stop();
     }
 
     void paint(juce::Graphics& g) override
     {
         auto bounds = getLocalBounds().toFloat();
         
+        // The component is opaque, so the corners outside the rounded
+        // rectangle get the editor's background colour
+        g.fillAll(juce::Colour(0xFF0A0A10));
+
         // Background
         g.setColour(juce::Colour(0xFF0D0D12));
         g.fillRoundedRectangle(bounds, 6.0f);
@@ -76,58 +71,70 @@ public:
         // Nothing needed
     }
 
+    // Called with every new spectrum (linear magnitudes and their number),
+    // so other views can share the one analysis.
+    std::function<void(const float*, int)> onNewSpectrum;
+
 private:
     void timerCallback() override
     {
-        if (nextFFTBlockReady)
+        int newNumBins = numBins;
+        if (feed.readSpectrum(spectrum, newNumBins))
         {
+            if (newNumBins != numBins)
+            {
+                numBins = newNumBins;
+                buildBinRanges();
+            }
             drawNextFrameOfSpectrum();
-            nextFFTBlockReady = false;
             repaint();
+            if (onNewSpectrum) onNewSpectrum(spectrum.data(), numBins);
         }
     }
 
-    void pushNextSampleIntoFifo(float sample)
+    // Works out which FFT bins every scope point covers, on a logarithmic
+    // frequency scale. Each point maps on its own, so at the low end
+    // neighbouring points share a bin and at the top end a point covers many
+    // bins, and the axis keeps its shape at every FFT size. Rebuilt whenever
+    // the FFT size changes.
+    void buildBinRanges()
     {
-        if (fifoIndex == fftSize)
+        auto binAt = [this](size_t i)
         {
-            if (!nextFFTBlockReady)
-            {
-                std::copy(fifo.begin(), fifo.end(), fftData.begin());
-                nextFFTBlockReady = true;
-            }
-            fifoIndex = 0;
+            auto skewedProportionX = 1.0f - std::pow(1.0f - static_cast<float>(i) / static_cast<float>(scopeSize), 0.2f);
+            return juce::jlimit(0, numBins - 1, static_cast<int>(std::floor(skewedProportionX * static_cast<float>(numBins))));
+        };
+
+        for (size_t i = 0; i < scopeSize; ++i)
+        {
+            binStart[i] = binAt(i);
+            binEnd[i] = i + 1 < scopeSize ? juce::jmax(binStart[i] + 1, binAt(i + 1)) : numBins;
         }
-        
-        fifo[static_cast<size_t>(fifoIndex++)] = sample;
     }
 
     void drawNextFrameOfSpectrum()
     {
-        // Apply window function
-        window.multiplyWithWindowingTable(fftData.data(), fftSize);
-        
-        // Perform FFT
-        forwardFFT.performFrequencyOnlyForwardTransform(fftData.data());
-        
-        // Convert to dB and smooth
-        auto mindB = -100.0f;
-        auto maxdB = 0.0f;
-        
+        const float mindB = -100.0f;
+        const float maxdB = 0.0f;
+
+        // Peak of the bins under each point, so no partial is skipped
         for (size_t i = 0; i < scopeSize; ++i)
         {
-            // Logarithmic frequency mapping
-            auto skewedProportionX = 1.0f - std::exp(std::log(1.0f - static_cast<float>(i) / static_cast<float>(scopeSize)) * 0.2f);
-            auto fftDataIndex = static_cast<size_t>(skewedProportionX * static_cast<float>(fftSize / 2));
-            
-            auto level = juce::jmap(juce::jlimit(mindB, maxdB,
-                juce::Decibels::gainToDecibels(fftData[fftDataIndex])
-                - juce::Decibels::gainToDecibels(static_cast<float>(fftSize))),
-                mindB, maxdB, 0.0f, 1.0f);
-            
-            // Smoothing
-            scopeData[i] = scopeData[i] * 0.7f + level * 0.3f;
+            levels[i] = juce::FloatVectorOperations::findMaximum(spectrum.data() + binStart[i], binEnd[i] - binStart[i]);
         }
+
+        // Map mindB..maxdB to 0..1: clip the gains, then take a log and scale
+        const int n = static_cast<int>(scopeSize);
+        juce::FloatVectorOperations::clip(levels.data(), levels.data(), juce::Decibels::decibelsToGain(mindB), juce::Decibels::decibelsToGain(maxdB), n);
+        for (auto& level : levels)
+            level = std::log(level);
+        const float dBPerNeper = 20.0f / std::log(10.0f);
+        juce::FloatVectorOperations::multiply(levels.data(), dBPerNeper / (maxdB - mindB), n);
+        juce::FloatVectorOperations::add(levels.data(), -mindB / (maxdB - mindB), n);
+
+        // Smoothing
+        juce::FloatVectorOperations::multiply(scopeData.data(), 0.7f, n);
+        juce::FloatVectorOperations::addWithMultiply(scopeData.data(), levels.data(), 0.3f, n);
     }
 
     void drawSpectrum(juce::Graphics& g, juce::Rectangle<float> bounds)
@@ -189,19 +196,18 @@ private:
         g.strokePath(outlinePath, juce::PathStrokeType(1.5f));
     }
 
-    static constexpr int fftOrder = 11;
-    static constexpr int fftSize = 1 << fftOrder;  // 2048
     static constexpr size_t scopeSize = 256;
 
-    juce::dsp::FFT forwardFFT;
-    juce::dsp::WindowingFunction<float> window;
+    AnalyzerFeed& feed;
 
-    std::array<float, fftSize> fifo;
-    std::array<float, fftSize * 2> fftData;
+    // The newest spectrum and its size
+    std::vector<float> spectrum;
+    int numBins = 1 << (AnalyzerFeed::MINORDER + 1);
     std::array<float, scopeSize> scopeData;
-    
-    int fifoIndex = 0;
-    bool nextFFTBlockReady = false;
+
+    // Scope point i shows FFT bins binStart[i] to binEnd[i] - 1
+    std::array<int, scopeSize> binStart, binEnd;
+    std::array<float, scopeSize> levels;
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SpectrumAnalyzer)
 };
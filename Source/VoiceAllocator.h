@@ -0,0 +1,168 @@
+#pragma once
+
+#include "JuceHeader.h"
+#include <algorithm>
+#include <iterator>
+
+// Keeps track of which voice slot plays which note, so that note on, note off
+// and sustain pedal release never have to scan the voice bank.
+//
+// Every active slot has a key: the MIDI note holding it, SUSTAINED when the key
+// is up but the pedal is down, RELEASED once it is fading out, or STOLEN when
+// it is fading out to make room for another note. Each key has a list of its
+// slots in the order they got the key. The slots that are not STOLEN are also
+// on an age list, oldest first. All lists are intrusive doubly-linked lists
+// indexed by slot, so every change is O(1).
+template <size_t NumSlots>
+class VoiceAllocator
+{
+public:
+    static const int SUSTAINED = 128, RELEASED = 129, STOLEN = 130;
+
+    enum StealPolicy { StealQuietest, StealOldest, StealReleasedFirst, NUMSTEALPOLICIES };
+
+    VoiceAllocator() { reset(); }
+
+    void reset()
+    {
+        std::fill(std::begin(keyHead), std::end(keyHead), -1);
+        std::fill(std::begin(keyTail), std::end(keyTail), -1);
+        std::fill(std::begin(key), std::end(key), -1);
+        ageHead = ageTail = -1;
+        numPlaying = 0;
+        orderValid = false;
+    }
+
+    // Number of slots that count towards the polyphony (everything but STOLEN).
+    int getNumPlaying() const { return numPlaying; }
+
+    int getKey(int slot) const { return key[slot]; }
+    int firstWithKey(int k) const { return keyHead[k]; }
+    int nextWithSameKey(int slot) const { return keyNext[slot]; }
+
+    // Registers a newly started slot as the youngest voice.
+    void add(int slot, int k)
+    {
+        ++generation[slot];
+        key[slot] = k;
+        linkKey(slot);
+        linkAge(slot);
+    }
+
+    // Changes the key of an active slot, moving it to the end of that key's list.
+    void setKey(int slot, int k)
+    {
+        if (key[slot] == k) return;
+        const bool wasStolen = key[slot] == STOLEN;
+        unlinkKey(slot);
+        key[slot] = k;
+        linkKey(slot);
+        if (k == STOLEN) unlinkAge(slot);
+        else if (wasStolen) linkAge(slot);
+    }
+
+    // Forgets a slot whose voice has finished.
+    void remove(int slot)
+    {
+        unlinkKey(slot);
+        if (key[slot] != STOLEN) unlinkAge(slot);
+        key[slot] = -1;
+    }
+
+    // The voice in slot from has been moved to the unused slot to.
+    void move(int from, int to)
+    {
+        jassert(key[to] < 0);
+        ++generation[to];
+        key[to] = key[from]; keyPrev[to] = keyPrev[from]; keyNext[to] = keyNext[from];
+        (keyPrev[to] >= 0 ? keyNext[keyPrev[to]] : keyHead[key[to]]) = to;
+        (keyNext[to] >= 0 ? keyPrev[keyNext[to]] : keyTail[key[to]]) = to;
+        if (key[to] != STOLEN) {
+            agePrev[to] = agePrev[from]; ageNext[to] = ageNext[from];
+            (agePrev[to] >= 0 ? ageNext[agePrev[to]] : ageHead) = to;
+            (ageNext[to] >= 0 ? agePrev[ageNext[to]] : ageTail) = to;
+        }
+        key[from] = -1;
+    }
+
+    // The slot to steal for a new note, or -1 if every active slot is already
+    // being stolen. For StealQuietest the playing slots are sorted by envelope
+    // level once, on the first steal after invalidateOrder(), and later steals
+    // take the next one from that order, skipping slots that have been
+    // restarted since, e.g. by a note that cut off the voice there.
+    int findVictim(StealPolicy policy, const float *env)
+    {
+        if (policy == StealReleasedFirst && keyHead[RELEASED] >= 0) return keyHead[RELEASED];
+        if (policy == StealQuietest) {
+            if (!orderValid) {
+                orderSize = 0;
+                for (int slot = ageHead; slot >= 0; slot = ageNext[slot]) order[orderSize++] = slot;
+                std::sort(order, order + orderSize, [env](int a, int b) { return env[a] < env[b]; });
+                for (int i = 0; i < orderSize; ++i) orderGeneration[i] = generation[order[i]];
+                orderPos = 0;
+                orderValid = true;
+            }
+            while (orderPos < orderSize) {
+                const int slot = order[orderPos];
+                const unsigned slotGeneration = orderGeneration[orderPos++];
+                if (key[slot] >= 0 && key[slot] != STOLEN && generation[slot] == slotGeneration) return slot;
+            }
+        }
+        return ageHead;
+    }
+
+    // Call whenever the envelopes have moved on or slots were moved, i.e. at
+    // the end of every block.
+    void invalidateOrder() { orderValid = false; }
+
+private:
+    void linkKey(int slot)
+    {
+        const int k = key[slot];
+        keyPrev[slot] = keyTail[k]; keyNext[slot] = -1;
+        (keyTail[k] >= 0 ? keyNext[keyTail[k]] : keyHead[k]) = slot;
+        keyTail[k] = slot;
+    }
+
+    void unlinkKey(int slot)
+    {
+        const int k = key[slot];
+        (keyPrev[slot] >= 0 ? keyNext[keyPrev[slot]] : keyHead[k]) = keyNext[slot];
+        (keyNext[slot] >= 0 ? keyPrev[keyNext[slot]] : keyTail[k]) = keyPrev[slot];
+    }
+
+    void linkAge(int slot)
+    {
+        agePrev[slot] = ageTail; ageNext[slot] = -1;
+        (ageTail >= 0 ? ageNext[ageTail] : ageHead) = slot;
+        ageTail = slot;
+        ++numPlaying;
+    }
+
+    void unlinkAge(int slot)
+    {
+        (agePrev[slot] >= 0 ? ageNext[agePrev[slot]] : ageHead) = ageNext[slot];
+        (ageNext[slot] >= 0 ? agePrev[ageNext[slot]] : ageTail) = agePrev[slot];
+        --numPlaying;
+    }
+
+    static const int NUMKEYS = STOLEN + 1;
+
+    int key[NumSlots];
+    int keyPrev[NumSlots], keyNext[NumSlots];
+    int keyHead[NUMKEYS], keyTail[NUMKEYS];
+    int agePrev[NumSlots], ageNext[NumSlots];
+    int ageHead = -1, ageTail = -1;
+    int numPlaying = 0;
+
+    // Counts the voices started in each slot, so a cached order can tell a
+    // slot's new voice from the one it was sorted for.
+    unsigned generation[NumSlots] = {};
+
+    // Playing slots sorted by envelope level, for StealQuietest, with the
+    // generation each one had when sorted.
+    int order[NumSlots];
+    unsigned orderGeneration[NumSlots];
+    int orderSize = 0, orderPos = 0;
+    bool orderValid = false;
+};
@@ -0,0 +1,235 @@
+#pragma once
+
+#include "JuceHeader.h"
+#include <atomic>
+#include <vector>
+
+#if JUCE_INTEL
+ #include <immintrin.h>
+#endif
+
+// A small pool of worker threads that helps the audio thread render the
+// active voices. The voices are split into ranges, one more than the number
+// of workers. Each range is rendered into its own buffer, and the audio thread
+// sums those buffers at the end.
+//
+// Ranges are claimed through a single atomic word that holds the job's
+// serial number, its number of ranges and the next range to hand out, so a
+// worker can never claim a range of one job against the range count of
+// another. A claimed range is then started through its own state word, which
+// lets the audio thread take back a range that a worker claimed but never
+// started.
+//
+// The audio thread renders every range that no worker has picked up, so it
+// never waits for a worker to wake up and never allocates. The worst case is
+// that it renders everything itself, just as it would without the pool. If a
+// worker is late with a range, for example because it was preempted, the
+// audio thread spins for at most STALLTIME, then takes the range back if it
+// hasn't started, or otherwise sleeps until it is done so the worker can have
+// the core.
+//
+// Workers spin for SPINTIME after their last range, which covers the chunks
+// of one block, then sleep until render() wakes them.
+class VoiceRenderPool
+{
+public:
+    // Renders voices [firstVoice, endVoice) into out, overwriting it.
+    struct Client
+    {
+        virtual ~Client() = default;
+        virtual void renderVoiceRange(int firstVoice, int endVoice, float *out, int numSamples) = 0;
+    };
+
+    static constexpr int MAXTHREADS = 7;
+
+    explicit VoiceRenderPool(int maxSamplesPerJob)
+        : maxSamples(maxSamplesPerJob),
+          rangeBuffers(size_t((MAXTHREADS + 1) * maxSamplesPerJob), 0.0f)
+    {
+    }
+
+    ~VoiceRenderPool()
+    {
+        setNumThreads(0);
+    }
+
+    // Starts or stops worker threads. Call from the message thread. It is safe
+    // to do this while the audio thread is rendering.
+    void setNumThreads(int numThreads)
+    {
+        numThreads = juce::jlimit(0, MAXTHREADS, numThreads);
+
+        while (int(workers.size()) > numThreads) {
+            workers.back()->signalThreadShouldExit();
+            wakeEvents[workers.size() - 1].signal();
+            workers.back()->stopThread(1000);
+            workers.pop_back();
+        }
+        while (int(workers.size()) < numThreads) {
+            workers.push_back(std::make_unique<Worker>(*this, int(workers.size())));
+            workers.back()->startThread(juce::Thread::Priority::highest);
+        }
+        activeThreads = numThreads;
+    }
+
+    int getNumThreads() const { return activeThreads; }
+
+    // Renders voices [0, numVoices) into out, sharing the work with the
+    // workers. Ranges are aligned to granularity voices (the SIMD width).
+    // Call from the audio thread only, with numSamples <= maxSamplesPerJob.
+    void render(Client &jobClient, int numVoices, int granularity, float *out, int numSamples)
+    {
+        jassert(numSamples <= maxSamples);
+
+        const int numGroups = (numVoices + granularity - 1) / granularity;
+        const int numJobRanges = juce::jmax(1, juce::jmin(activeThreads.load() + 1, numGroups));
+        for (int r = 0; r <= numJobRanges; ++r)
+            rangeStart[r] = juce::jmin(numVoices, (r * numGroups / numJobRanges) * granularity);
+
+        // Every range of the previous job has been claimed and rendered, so
+        // no worker is reading the job. Close the claim word anyway before
+        // rewriting it, so nothing can be handed out until it is published.
+        claim.store(serial << 16);
+
+        client = &jobClient;
+        jobSamples = numSamples;
+        serial = serial % 0xffff + 1;  // never 0, so a fresh state word matches no job
+        for (int r = 0; r < numJobRanges; ++r)
+            rangeState[r].store(serial * 4 + OPEN, std::memory_order_relaxed);
+        claim.store(serial << 16 | uint32_t(numJobRanges) << 8);
+
+        // Wake sleeping workers. A worker that goes to sleep checks for work
+        // after saying so, so it can't miss this job.
+        for (int i = 0, toWake = numJobRanges - 1; i < MAXTHREADS && toWake > 0; ++i)
+            if (sleeping[i].load()) { wakeEvents[i].signal(); --toWake; }
+
+        // Render whatever the workers haven't picked up, then wait for the rest
+        while (claimAndRender()) {}
+        const auto deadline = juce::Time::getHighResolutionTicks() + juce::Time::secondsToHighResolutionTicks(STALLTIME);
+        for (int r = 0; r < numJobRanges; ++r) {
+            while (rangeState[r].load(std::memory_order_acquire) != serial * 4 + DONE) {
+                if (juce::Time::getHighResolutionTicks() < deadline) { spinPause(); continue; }
+                if (startRange(r, serial)) { renderRange(r, serial); break; }
+                audioThreadWaiting = true;
+                if (rangeState[r].load() != serial * 4 + DONE) rangeDoneEvent.wait(1);
+                audioThreadWaiting = false;
+            }
+        }
+
+        juce::FloatVectorOperations::copy(out, rangeBuffers.data(), numSamples);
+        for (int r = 1; r < numJobRanges; ++r)
+            juce::FloatVectorOperations::add(out, rangeBuffers.data() + r * maxSamples, numSamples);
+    }
+
+private:
+    class Worker : public juce::Thread
+    {
+    public:
+        Worker(VoiceRenderPool &p, int index) : juce::Thread("DX10 voice worker " + juce::String(index)), pool(p), workerIndex(index) {}
+
+        void run() override
+        {
+            juce::ScopedNoDenormals noDenormals;
+            const auto spinTicks = juce::Time::secondsToHighResolutionTicks(SPINTIME);
+            auto lastWork = juce::Time::getHighResolutionTicks();
+            while (!threadShouldExit()) {
+                if (pool.claimAndRender()) { lastWork = juce::Time::getHighResolutionTicks(); continue; }
+                if (juce::Time::getHighResolutionTicks() - lastWork < spinTicks) { spinPause(); continue; }
+
+                // Nothing for a while: sleep until render() publishes a job
+                pool.sleeping[workerIndex] = true;
+                if (!pool.hasWork() && !threadShouldExit()) pool.wakeEvents[workerIndex].wait(-1);
+                pool.sleeping[workerIndex] = false;
+                lastWork = juce::Time::getHighResolutionTicks();
+            }
+        }
+
+    private:
+        VoiceRenderPool &pool;
+        const int workerIndex;
+    };
+
+    bool hasWork() const
+    {
+        const uint32_t c = claim.load();
+        return (c & 0xff) < ((c >> 8) & 0xff);
+    }
+
+    // Claims the next unrendered range of the current job and renders it.
+    // Returns false when every range has already been claimed.
+    bool claimAndRender()
+    {
+        uint32_t c = claim.load(std::memory_order_acquire);
+        for (;;) {
+            if ((c & 0xff) >= ((c >> 8) & 0xff)) return false;
+            if (claim.compare_exchange_weak(c, c + 1, std::memory_order_acq_rel)) break;
+        }
+
+        const int r = int(c & 0xff);
+        if (startRange(r, c >> 16)) renderRange(r, c >> 16);
+        return true;
+    }
+
+    // Marks range r of job jobSerial as started. Fails if the audio thread
+    // has taken the range back, or the job is over.
+    bool startRange(int r, uint32_t jobSerial)
+    {
+        uint32_t expected = jobSerial * 4 + OPEN;
+        return rangeState[r].compare_exchange_strong(expected, jobSerial * 4 + RUNNING, std::memory_order_acq_rel);
+    }
+
+    // Renders a started range. The job can't change until it is marked done.
+    void renderRange(int r, uint32_t jobSerial)
+    {
+        if (rangeStart[r] < rangeStart[r + 1])
+            client->renderVoiceRange(rangeStart[r], rangeStart[r + 1], rangeBuffers.data() + r * maxSamples, jobSamples);
+        else
+            juce::FloatVectorOperations::clear(rangeBuffers.data() + r * maxSamples, jobSamples);
+        rangeState[r].store(jobSerial * 4 + DONE);
+        if (audioThreadWaiting.load()) rangeDoneEvent.signal();
+    }
+
+    static void spinPause()
+    {
+       #if JUCE_INTEL
+        _mm_pause();
+       #endif
+    }
+
+    // How long a worker spins for the next job before it sleeps, and how long
+    // the audio thread spins for a late range before it steps in
+    static constexpr double SPINTIME = 0.00005, STALLTIME = 0.0001;
+
+    // A range's state word is jobSerial * 4 + one of these
+    enum RangeState : uint32_t { OPEN, RUNNING, DONE };
+
+    const int maxSamples;
+    std::vector<float> rangeBuffers;
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::atomic<int> activeThreads { 0 };
+
+    // The current job. Only written by the audio thread while no range of the
+    // previous job is still in progress.
+    Client *client = nullptr;
+    int jobSamples = 0;
+    int rangeStart[MAXTHREADS + 2] = {};
+    uint32_t serial = 0;
+
+    // (job serial << 16) | (number of ranges << 8) | index of the next range
+    // to hand out. A closed word has no ranges.
+    std::atomic<uint32_t> claim { 0 };
+
+    // jobSerial * 4 + RangeState of each range, for the job it was last
+    // handed out in
+    std::atomic<uint32_t> rangeState[MAXTHREADS + 1] = {};
+
+    // Sleeping workers, indexed like workers, and what wakes them
+    std::atomic<bool> sleeping[MAXTHREADS] = {};
+    juce::WaitableEvent wakeEvents[MAXTHREADS];
+
+    // Set while the audio thread sleeps on a late range
+    std::atomic<bool> audioThreadWaiting { false };
+    juce::WaitableEvent rangeDoneEvent;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(VoiceRenderPool)
+};
@@ -0,0 +1,230 @@
+// DX10Benchmarks: measures what DX10AudioProcessor::processBlock costs, in
+// nanoseconds per output sample and as a multiple of realtime, and writes the
+// results as JSON so runs from different commits can be compared.
+//
+//   DX10Benchmarks [--out results.json] [--seconds 2.0] [--repeats 3]
+//                  [--threads 0] [--label <text>] [--full]
+//
+// Every case starts from a baseline (first factory preset, 8 voices, 512
+// sample blocks, 48 kHz, no saturation) and changes one thing: the preset,
+// the polyphony, the block size, the sample rate or the saturation. --full
+// also runs every combination of polyphony, block size, sample rate and
+// saturation, which takes a while.
+
+#include "../../Source/JuceHeader.h"
+#include "../../Source/PluginProcessor.h"
+#include <algorithm>
+#include <iostream>
+
+namespace
+{
+    struct BenchmarkCase
+    {
+        juce::String sweep;
+        int preset = 0;
+        int voices = DEFAULTVOICES;
+        int blockSize = 512;
+        double sampleRate = 48000.0;
+        bool saturation = false;
+    };
+
+    struct BenchmarkResult
+    {
+        double nsPerSample;     // median over the repeats
+        double nsPerSampleMin;  // best of the repeats
+        double realtime;        // audio seconds rendered per second, from the median
+    };
+
+    const int polyphonySweep[] = { 1, 2, 4, 8, 16, 32, 64, NVOICES };
+    const int blockSizeSweep[] = { 16, 32, 64, 128, 256, 512, 1024, 2048, 4096 };
+    const double sampleRateSweep[] = { 44100.0, 48000.0, 96000.0, 192000.0 };
+
+    void setParameter(DX10AudioProcessor& processor, const juce::String& id, float value)
+    {
+        if (auto* param = processor.apvts.getParameter(id))
+            param->setValueNotifyingHost(param->convertTo0to1(value));
+    }
+
+    // Plays one note per voice, and every quarter second releases them and
+    // plays them again, so the voices never decay to silence. Renders a short
+    // warm-up first, then times only the processBlock() calls.
+    BenchmarkResult runCase(const BenchmarkCase& c, double seconds, int repeats, int threads)
+    {
+        DX10AudioProcessor processor;
+        processor.setCurrentProgram(c.preset);
+        setParameter(processor, "Polyphony", float(c.voices));
+        setParameter(processor, "Saturation", c.saturation ? 1.0f : 0.0f);
+        processor.setRenderThreads(threads);
+        processor.setNonRealtime(false);
+        processor.setPlayConfigDetails(0, 2, c.sampleRate, c.blockSize);
+        processor.prepareToPlay(c.sampleRate, c.blockSize);
+
+        juce::AudioBuffer<float> buffer(2, c.blockSize);
+        juce::MidiBuffer midi;
+        const auto retriggerInterval = juce::int64(c.sampleRate * 0.25);
+        const auto warmupSamples = juce::int64(c.sampleRate * 0.2);
+        const auto timedSamples = juce::jmax(juce::int64(c.blockSize), juce::int64(seconds * c.sampleRate));
+
+        std::vector<double> nsPerSample;
+        juce::int64 position = 0;
+        for (int repeat = 0; repeat <= repeats; ++repeat)
+        {
+            // Pass 0 is the warm-up
+            const auto passSamples = repeat == 0 ? warmupSamples : timedSamples;
+            juce::int64 ticks = 0, rendered = 0;
+
+            for (; rendered < passSamples; rendered += c.blockSize, position += c.blockSize)
+            {
+                midi.clear();
+                const auto nextTrigger = (position + retriggerInterval - 1) / retriggerInterval * retriggerInterval;
+                if (nextTrigger < position + c.blockSize)
+                {
+                    const int offset = int(nextTrigger - position);
+                    for (int i = 0; i < c.voices; ++i)
+                    {
+                        const int note = (24 + i) % 128;
+                        if (nextTrigger > 0)
+                            midi.addEvent(juce::MidiMessage::noteOff(1, note), offset);
+                        midi.addEvent(juce::MidiMessage::noteOn(1, note, juce::uint8(100)), offset);
+                    }
+                }
+
+                const auto start = juce::Time::getHighResolutionTicks();
+                processor.processBlock(buffer, midi);
+                ticks += juce::Time::getHighResolutionTicks() - start;
+            }
+
+            if (repeat > 0)
+                nsPerSample.push_back(juce::Time::highResolutionTicksToSeconds(ticks) * 1.0e9 / double(rendered));
+        }
+
+        processor.releaseResources();
+
+        std::sort(nsPerSample.begin(), nsPerSample.end());
+        const double median = nsPerSample[nsPerSample.size() / 2];
+        return { median, nsPerSample.front(), median > 0.0 ? 1.0e9 / (median * c.sampleRate) : 0.0 };
+    }
+
+    std::vector<BenchmarkCase> makeCases(int numPresets, bool full)
+    {
+        std::vector<BenchmarkCase> cases;
+        const BenchmarkCase baseline;
+
+        for (int preset = 0; preset < numPresets; ++preset)
+        {
+            auto c = baseline; c.sweep = "preset"; c.preset = preset;
+            cases.push_back(c);
+        }
+        for (int voices : polyphonySweep)
+        {
+            auto c = baseline; c.sweep = "polyphony"; c.voices = voices;
+            cases.push_back(c);
+        }
+        for (int blockSize : blockSizeSweep)
+        {
+            auto c = baseline; c.sweep = "blockSize"; c.blockSize = blockSize;
+            cases.push_back(c);
+        }
+        for (double sampleRate : sampleRateSweep)
+        {
+            auto c = baseline; c.sweep = "sampleRate"; c.sampleRate = sampleRate;
+            cases.push_back(c);
+        }
+        for (bool saturation : { false, true })
+        {
+            auto c = baseline; c.sweep = "saturation"; c.saturation = saturation;
+            cases.push_back(c);
+        }
+
+        if (full)
+        {
+            for (int voices : polyphonySweep)
+                for (int blockSize : blockSizeSweep)
+                    for (double sampleRate : sampleRateSweep)
+                        for (bool saturation : { false, true })
+                        {
+                            auto c = baseline; c.sweep = "full";
+                            c.voices = voices; c.blockSize = blockSize; c.sampleRate = sampleRate; c.saturation = saturation;
+                            cases.push_back(c);
+                        }
+        }
+        return cases;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+    juce::ArgumentList args(argc, argv);
+
+    const double seconds = args.containsOption("--seconds") ? args.getValueForOption("--seconds").getDoubleValue() : 2.0;
+    const int repeats = args.containsOption("--repeats") ? juce::jmax(1, args.getValueForOption("--repeats").getIntValue()) : 3;
+    const int threads = args.containsOption("--threads") ? args.getValueForOption("--threads").getIntValue() : 0;
+
+    std::vector<juce::String> presetNames;
+    {
+        DX10AudioProcessor processor;
+        for (int i = 0; i < processor.getNumPresets(); ++i)
+            presetNames.push_back(processor.getPresetName(i));
+    }
+
+    const auto cases = makeCases(int(presetNames.size()), args.containsOption("--full"));
+    juce::Array<juce::var> results;
+
+    for (size_t i = 0; i < cases.size(); ++i)
+    {
+        const auto& c = cases[i];
+        const auto result = runCase(c, seconds, repeats, threads);
+
+        auto* entry = new juce::DynamicObject();
+        entry->setProperty("sweep", c.sweep);
+        entry->setProperty("preset", c.preset);
+        entry->setProperty("presetName", presetNames[size_t(c.preset)]);
+        entry->setProperty("voices", c.voices);
+        entry->setProperty("blockSize", c.blockSize);
+        entry->setProperty("sampleRate", c.sampleRate);
+        entry->setProperty("saturation", c.saturation);
+        entry->setProperty("nsPerSample", result.nsPerSample);
+        entry->setProperty("nsPerSampleMin", result.nsPerSampleMin);
+        entry->setProperty("realtime", result.realtime);
+        results.add(juce::var(entry));
+
+        std::cerr << "[" << (i + 1) << "/" << cases.size() << "] " << c.sweep << ": " << presetNames[size_t(c.preset)]
+                  << ", " << c.voices << " voices, " << c.blockSize << " samples, " << c.sampleRate << " Hz"
+                  << (c.saturation ? ", saturation" : "") << " -> " << juce::String(result.nsPerSample, 1) << " ns/sample, "
+                  << juce::String(result.realtime, 1) << "x realtime\n";
+    }
+
+    auto* root = new juce::DynamicObject();
+    root->setProperty("label", args.getValueForOption("--label"));
+    root->setProperty("date", juce::Time::getCurrentTime().toISO8601(true));
+    root->setProperty("juceVersion", juce::SystemStats::getJUCEVersion());
+    root->setProperty("cpu", juce::SystemStats::getCpuModel());
+    root->setProperty("cpuCores", juce::SystemStats::getNumPhysicalCpus());
+    root->setProperty("os", juce::SystemStats::getOperatingSystemName());
+   #if JUCE_DEBUG
+    root->setProperty("build", "Debug");
+   #else
+    root->setProperty("build", "Release");
+   #endif
+    root->setProperty("secondsPerCase", seconds);
+    root->setProperty("repeats", repeats);
+    root->setProperty("renderThreads", threads);
+    root->setProperty("results", results);
+
+    const auto json = juce::JSON::toString(juce::var(root));
+    if (args.containsOption("--out"))
+    {
+        const auto outFile = juce::File::getCurrentWorkingDirectory().getChildFile(args.getValueForOption("--out"));
+        if (!outFile.replaceWithText(json))
+        {
+            std::cerr << "could not write " << outFile.getFullPathName() << "\n";
+            return 1;
+        }
+    }
+    else
+    {
+        std::cout << json << "\n";
+    }
+    return 0;
+}
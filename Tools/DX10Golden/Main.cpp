@@ -0,0 +1,389 @@
+// DX10Golden: renders a fixed set of MIDI scripts through every factory
+// preset and compares the output against reference renders, so changes to
+// the DSP code can be checked for changes to the sound.
+//
+//   DX10GoldenBaseline --record <dir>          write the reference renders
+//   DX10Golden --check <dir> [--tolerance 1e-6] [--spectral-tolerance 0.1] [--strict] [--block-sizes 256,1000]
+//
+// DX10GoldenBaseline is this file built against the engine as of the
+// baseline commit (see CMakeLists.txt), so the references hold the sound from
+// before any of the DSP work. DX10Golden --record records references from the
+// current build instead.
+//
+// Without a tolerance the check is bit-exact. --tolerance is the largest
+// allowed sample difference; --spectral-tolerance is the largest allowed
+// difference in dB between the average spectra, which accepts changes that
+// shift the phase but not the timbre. With only --spectral-tolerance, the
+// sample difference is reported but not checked. Exits with 1 if any render
+// fails.
+//
+// The references are rendered in blocks of 256 samples. The check renders
+// every script at each of --block-sizes (256 and 1000 by default) against
+// the same reference, so output that depends on the host's block size fails.
+// Parameter automation always lands at its exact sample: the block is ended
+// there, as hosts with sample-accurate automation do.
+//
+// Some scripts exercise behaviour that was changed on purpose since the
+// baseline. Against baseline references they are reported as CHANGED with
+// their differences, but only fail with --strict.
+//
+// The synth is mono and copies its output to every channel, so the
+// references hold the first channel only, as 32-bit float WAV files.
+
+#include "JuceHeader.h"
+#include "PluginProcessor.h"
+#include <iostream>
+#include <limits>
+
+namespace
+{
+    const double sampleRate = 44100.0;
+    const int referenceBlockSize = 256;
+    const int fftOrder = 12;
+
+    // A parameter change, by parameter ID, to a normalised value
+    struct Automation
+    {
+        double time;
+        const char* parameterID;
+        float value;
+    };
+
+    // A short MIDI performance with optional parameter automation, timed in
+    // seconds. changedSinceBaseline says why it is expected to sound
+    // different from the baseline engine, or is null if it should not.
+    struct Script
+    {
+        const char* name;
+        double length;
+        const char* changedSinceBaseline;
+        juce::MidiMessageSequence events;
+        std::vector<Automation> automation;
+    };
+
+    std::vector<Script> makeScripts()
+    {
+        std::vector<Script> scripts;
+
+        {
+            // A held chord and its release
+            Script s { "chord", 2.0, nullptr, {} };
+            for (int note : { 48, 55, 60, 64, 67 })
+            {
+                s.events.addEvent(juce::MidiMessage::noteOn(1, note, juce::uint8(100)), 0.0);
+                s.events.addEvent(juce::MidiMessage::noteOff(1, note), 1.0);
+            }
+            scripts.push_back(std::move(s));
+        }
+        {
+            // Short notes over four octaves with varying velocity. Eight
+            // notes, so no voice is ever stolen.
+            Script s { "arpeggio", 2.0, nullptr, {} };
+            for (int i = 0; i < 8; ++i)
+            {
+                const int note = 36 + (i * 7) % 48;
+                s.events.addEvent(juce::MidiMessage::noteOn(1, note, juce::uint8(30 + (i * 37) % 97)), i * 0.2);
+                s.events.addEvent(juce::MidiMessage::noteOff(1, note), i * 0.2 + 0.08);
+            }
+            scripts.push_back(std::move(s));
+        }
+        {
+            // Pitch bend, mod wheel and the sustain pedal on held notes
+            Script s { "expression", 2.0, "pitch bend and controllers now apply at their sample position, not at the start of the block", {} };
+            s.events.addEvent(juce::MidiMessage::controllerEvent(1, 64, 127), 0.0);
+            s.events.addEvent(juce::MidiMessage::noteOn(1, 57, juce::uint8(90)), 0.0);
+            s.events.addEvent(juce::MidiMessage::noteOn(1, 64, juce::uint8(70)), 0.1);
+            s.events.addEvent(juce::MidiMessage::noteOff(1, 57), 0.3);
+            s.events.addEvent(juce::MidiMessage::noteOff(1, 64), 0.4);
+            for (int i = 0; i <= 20; ++i)
+            {
+                s.events.addEvent(juce::MidiMessage::pitchWheel(1, 8192 + int(8191.0 * std::sin(i * 0.3))), 0.2 + i * 0.04);
+                s.events.addEvent(juce::MidiMessage::controllerEvent(1, 1, i * 6), 0.2 + i * 0.04);
+            }
+            s.events.addEvent(juce::MidiMessage::controllerEvent(1, 64, 0), 1.2);
+            scripts.push_back(std::move(s));
+        }
+        {
+            // Moves the ramped parameters under a held chord, at times that
+            // are neither on a block boundary nor on the automation grid.
+            // Smoothing is off by default, so the values still jump.
+            Script s { "automation", 2.0, nullptr, {}, {} };
+            for (int note : { 45, 52, 57, 61 })
+            {
+                s.events.addEvent(juce::MidiMessage::noteOn(1, note, juce::uint8(100)), 0.0);
+                s.events.addEvent(juce::MidiMessage::noteOff(1, note), 1.5);
+            }
+            s.automation = { { 0.2013, "Waveform", 0.9f }, { 0.4517, "Mod Thru", 0.7f }, { 0.7031, "Gain", 0.8f },
+                             { 0.9049, "Saturation", 0.6f }, { 1.1003, "Waveform", 0.1f }, { 1.2519, "Gain", 0.3f } };
+            scripts.push_back(std::move(s));
+        }
+        {
+            // More notes than the default polyphony, so voices get stolen
+            Script s { "stealing", 2.0, "stolen voices now fade out over about 5 ms instead of being cut off", {} };
+            for (int i = 0; i < 24; ++i)
+                s.events.addEvent(juce::MidiMessage::noteOn(1, 40 + i * 2, juce::uint8(64 + i)), i * 0.02);
+            for (int i = 0; i < 24; ++i)
+                s.events.addEvent(juce::MidiMessage::noteOff(1, 40 + i * 2), 1.0);
+            scripts.push_back(std::move(s));
+        }
+
+        for (auto& s : scripts)
+            s.events.sort();
+        return scripts;
+    }
+
+    void setParameter(juce::AudioProcessor& processor, const juce::String& parameterID, float value)
+    {
+        for (auto* parameter : processor.getParameters())
+            if (auto* withID = dynamic_cast<juce::AudioProcessorParameterWithID*>(parameter); withID != nullptr && withID->paramID == parameterID)
+                withID->setValueNotifyingHost(value);
+    }
+
+    juce::AudioBuffer<float> render(int preset, const Script& script, int blockSize)
+    {
+        DX10AudioProcessor processor;
+        processor.setCurrentProgram(preset);
+       #if ! DX10_GOLDEN_BASELINE
+        processor.setRenderThreads(0);
+       #endif
+        processor.setNonRealtime(false);
+        processor.setPlayConfigDetails(0, 2, sampleRate, blockSize);
+        processor.prepareToPlay(sampleRate, blockSize);
+
+        const int length = int(script.length * sampleRate);
+        juce::AudioBuffer<float> result(1, length);
+        juce::AudioBuffer<float> buffer(2, blockSize);
+        juce::MidiBuffer midi;
+        int nextEvent = 0;
+        size_t nextChange = 0;
+        auto changePosition = [&](size_t i) { return juce::roundToInt(script.automation[i].time * sampleRate); };
+
+        for (int position = 0; position < length;)
+        {
+            for (; nextChange < script.automation.size() && changePosition(nextChange) <= position; ++nextChange)
+                setParameter(processor, script.automation[nextChange].parameterID, script.automation[nextChange].value);
+
+            int end = position + blockSize;
+            if (nextChange < script.automation.size())
+                end = juce::jmin(end, changePosition(nextChange));
+
+            midi.clear();
+            for (; nextEvent < script.events.getNumEvents(); ++nextEvent)
+            {
+                const auto& message = script.events.getEventPointer(nextEvent)->message;
+                const int samplePosition = juce::roundToInt(message.getTimeStamp() * sampleRate);
+                if (samplePosition >= end)
+                    break;
+                midi.addEvent(message, samplePosition - position);
+            }
+
+            juce::AudioBuffer<float> block(buffer.getArrayOfWritePointers(), 2, end - position);
+            processor.processBlock(block, midi);
+            result.copyFrom(0, position, block, 0, 0, juce::jmin(end, length) - position);
+            position = end;
+        }
+
+        processor.releaseResources();
+        return result;
+    }
+
+    // Average magnitude spectrum in dB, from Hann-windowed frames that
+    // overlap by half.
+    std::vector<float> averageSpectrum(const juce::AudioBuffer<float>& audio)
+    {
+        const int fftSize = 1 << fftOrder;
+        juce::dsp::FFT fft(fftOrder);
+        juce::dsp::WindowingFunction<float> window(size_t(fftSize), juce::dsp::WindowingFunction<float>::hann, false);
+        std::vector<float> frame(size_t(fftSize * 2)), sum(size_t(fftSize / 2 + 1), 0.0f);
+
+        int numFrames = 0;
+        for (int start = 0; start + fftSize <= audio.getNumSamples(); start += fftSize / 2, ++numFrames)
+        {
+            std::fill(frame.begin(), frame.end(), 0.0f);
+            juce::FloatVectorOperations::copy(frame.data(), audio.getReadPointer(0, start), fftSize);
+            window.multiplyWithWindowingTable(frame.data(), size_t(fftSize));
+            fft.performFrequencyOnlyForwardTransform(frame.data(), true);
+            juce::FloatVectorOperations::add(sum.data(), frame.data(), int(sum.size()));
+        }
+
+        for (auto& bin : sum)
+            bin = juce::Decibels::gainToDecibels(bin / float(juce::jmax(1, numFrames) * fftSize / 2), -140.0f);
+        return sum;
+    }
+
+    struct Difference
+    {
+        float maxError = 0.0f;  // largest sample difference
+        int maxErrorSample = 0;
+        float spectralMaxDb = 0.0f;  // largest difference between the spectra
+        float spectralRmsDb = 0.0f;
+    };
+
+    // Compares a render with its reference. Spectrum bins where both are
+    // below -100 dB are left out, since they only hold noise.
+    Difference compare(const juce::AudioBuffer<float>& reference, const juce::AudioBuffer<float>& actual)
+    {
+        Difference d;
+        const auto* ref = reference.getReadPointer(0);
+        const auto* out = actual.getReadPointer(0);
+        for (int i = 0; i < actual.getNumSamples(); ++i)
+        {
+            const float error = std::isfinite(out[i]) ? std::abs(ref[i] - out[i]) : std::numeric_limits<float>::infinity();
+            if (error > d.maxError) { d.maxError = error; d.maxErrorSample = i; }
+        }
+
+        const auto refSpectrum = averageSpectrum(reference), outSpectrum = averageSpectrum(actual);
+        double sumSquares = 0.0;
+        int numBins = 0;
+        for (size_t bin = 0; bin < refSpectrum.size(); ++bin)
+        {
+            if (refSpectrum[bin] < -100.0f && outSpectrum[bin] < -100.0f)
+                continue;
+            const float diff = std::abs(refSpectrum[bin] - outSpectrum[bin]);
+            d.spectralMaxDb = juce::jmax(d.spectralMaxDb, diff);
+            sumSquares += double(diff) * diff;
+            ++numBins;
+        }
+        d.spectralRmsDb = numBins > 0 ? float(std::sqrt(sumSquares / numBins)) : 0.0f;
+        return d;
+    }
+
+    juce::File referenceFile(const juce::File& dir, int preset, const juce::String& presetName, const char* script)
+    {
+        const auto name = juce::String(preset).paddedLeft('0', 2) + "_" + juce::File::createLegalFileName(presetName).replaceCharacter(' ', '_');
+        return dir.getChildFile(name + "_" + script + ".wav");
+    }
+
+    bool writeReference(const juce::File& file, const juce::AudioBuffer<float>& audio)
+    {
+        file.deleteFile();
+        std::unique_ptr<juce::OutputStream> stream = std::make_unique<juce::FileOutputStream>(file);
+        juce::WavAudioFormat wavFormat;
+        std::unique_ptr<juce::AudioFormatWriter> writer(wavFormat.createWriterFor(stream.get(), sampleRate, 1, 32, {}, 0));
+        if (writer == nullptr)
+            return false;
+        stream.release();  // the writer owns the stream now
+        return writer->writeFromAudioSampleBuffer(audio, 0, audio.getNumSamples());
+    }
+
+    bool readReference(juce::AudioFormatManager& formats, const juce::File& file, juce::AudioBuffer<float>& audio)
+    {
+        std::unique_ptr<juce::AudioFormatReader> reader(formats.createReaderFor(file));
+        if (reader == nullptr)
+            return false;
+        audio.setSize(1, int(reader->lengthInSamples));
+        return reader->read(&audio, 0, audio.getNumSamples(), 0, true, false);
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+    juce::ArgumentList args(argc, argv);
+
+    const bool record = args.containsOption("--record");
+    const juce::String dirName = args.getValueForOption(record ? "--record" : "--check");
+    if (dirName.isEmpty())
+    {
+        std::cout << "usage: DX10Golden --record <dir>\n"
+                     "       DX10Golden --check <dir> [--tolerance <max sample difference>] [--spectral-tolerance <dB>] [--strict]\n"
+                     "                  [--block-sizes <n,n,...>]\n";
+        return 1;
+    }
+
+    const auto dir = juce::File::getCurrentWorkingDirectory().getChildFile(dirName);
+    if (record && !dir.createDirectory())
+    {
+        std::cerr << "could not create " << dir.getFullPathName() << "\n";
+        return 1;
+    }
+
+    const bool checkSamples = args.containsOption("--tolerance") || !args.containsOption("--spectral-tolerance");
+    const float tolerance = args.containsOption("--tolerance") ? args.getValueForOption("--tolerance").getFloatValue() : 0.0f;
+    const bool checkSpectrum = args.containsOption("--spectral-tolerance");
+    const float spectralTolerance = args.getValueForOption("--spectral-tolerance").getFloatValue();
+    const bool strict = args.containsOption("--strict");
+
+    std::vector<int> blockSizes { referenceBlockSize };
+    if (!record)
+    {
+        juce::StringArray sizes;
+        sizes.addTokens(args.containsOption("--block-sizes") ? args.getValueForOption("--block-sizes") : juce::String("256,1000"), ",", {});
+        blockSizes.clear();
+        for (const auto& size : sizes)
+            if (size.getIntValue() > 0)
+                blockSizes.push_back(size.getIntValue());
+    }
+
+    juce::AudioFormatManager formats;
+    formats.registerBasicFormats();
+
+    std::vector<juce::String> presetNames;
+    {
+        DX10AudioProcessor processor;
+        for (int i = 0; i < processor.getNumPresets(); ++i)
+            presetNames.push_back(processor.getPresetName(i));
+    }
+
+    const auto scripts = makeScripts();
+    int numFailed = 0, numChanged = 0, numRenders = 0;
+
+    for (int preset = 0; preset < int(presetNames.size()); ++preset)
+    {
+        for (const auto& script : scripts)
+        {
+            for (const int blockSize : blockSizes)
+            {
+                ++numRenders;
+                const auto file = referenceFile(dir, preset, presetNames[size_t(preset)], script.name);
+                const auto audio = render(preset, script, blockSize);
+                const auto label = presetNames[size_t(preset)] + " / " + script.name + " / " + juce::String(blockSize) + " samples";
+
+                if (record)
+                {
+                    if (!writeReference(file, audio))
+                    {
+                        std::cerr << "could not write " << file.getFullPathName() << "\n";
+                        return 1;
+                    }
+                    continue;
+                }
+
+                juce::AudioBuffer<float> reference;
+                if (!readReference(formats, file, reference) || reference.getNumSamples() != audio.getNumSamples())
+                {
+                    std::cout << "FAIL " << label << ": missing or wrong length reference " << file.getFileName() << "\n";
+                    ++numFailed;
+                    continue;
+                }
+
+                const auto d = compare(reference, audio);
+                const bool passed = (!checkSamples || d.maxError <= tolerance) && (!checkSpectrum || d.spectralMaxDb <= spectralTolerance);
+                if (!passed)
+                {
+                    const bool expected = script.changedSinceBaseline != nullptr && !strict;
+                    ++(expected ? numChanged : numFailed);
+                    std::cout << (expected ? "CHANGED " : "FAIL ") << label << ": max error " << juce::String(d.maxError, 9)
+                              << " (" << juce::String(juce::Decibels::gainToDecibels(d.maxError, -200.0f), 1) << " dBFS) at "
+                              << juce::String(d.maxErrorSample / sampleRate, 4) << " s, spectral difference max "
+                              << juce::String(d.spectralMaxDb, 3) << " dB, rms " << juce::String(d.spectralRmsDb, 3) << " dB\n";
+                    if (expected)
+                        std::cout << "    expected: " << script.changedSinceBaseline << "\n";
+                }
+            }
+        }
+    }
+
+    if (record)
+    {
+        std::cout << "recorded " << numRenders << " renders to " << dir.getFullPathName() << "\n";
+        return 0;
+    }
+
+    std::cout << (numRenders - numFailed - numChanged) << " of " << numRenders << " renders match"
+              << (checkSamples && juce::exactlyEqual(tolerance, 0.0f) && !checkSpectrum ? " bit-exactly" : "");
+    if (numChanged > 0)
+        std::cout << ", " << numChanged << " differ as expected";
+    std::cout << "\n";
+    return numFailed > 0 ? 1 : 0;
+}
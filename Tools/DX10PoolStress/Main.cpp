@@ -0,0 +1,110 @@
+// DX10PoolStress: runs many short jobs through a VoiceRenderPool with more
+// workers than ranges, and checks that every voice of every job is rendered
+// exactly once, never by two threads at the same time, and that the summed
+// output is complete. Now and then a render stalls for a millisecond, like
+// a preempted worker, so the audio thread's late-range path runs too.
+//
+//   DX10PoolStress [--jobs 200000] [--threads 7]
+//
+// Exits with 1 on the first failure. Runs as a CTest test.
+
+#include "../../Source/JuceHeader.h"
+#include "../../Source/VoiceRenderPool.h"
+#include <iostream>
+
+namespace
+{
+    const int maxVoices = 32;
+    const int maxSamples = 32;
+
+    // Counts how often each voice is rendered and catches two threads
+    // rendering the same voice at once. Each voice writes v + 1 to every
+    // sample, so the sum of a job is known.
+    struct CountingClient : VoiceRenderPool::Client
+    {
+        void renderVoiceRange(int firstVoice, int endVoice, float* out, int numSamples) override
+        {
+            for (int v = firstVoice; v < endVoice; ++v)
+                if (busy[v].exchange(true, std::memory_order_acquire))
+                    overlaps.fetch_add(1);
+
+            juce::FloatVectorOperations::clear(out, numSamples);
+            for (int v = firstVoice; v < endVoice; ++v)
+            {
+                juce::FloatVectorOperations::add(out, float(v + 1), numSamples);
+                renders[v].fetch_add(1, std::memory_order_relaxed);
+            }
+
+            // Hold the voices for a moment, so overlaps have a chance to show
+            for (int i = 0; i < 50; ++i)
+                spin.fetch_add(1, std::memory_order_relaxed);
+            if (calls.fetch_add(1, std::memory_order_relaxed) % 4999 == 4998)
+                juce::Thread::sleep(1);
+
+            for (int v = firstVoice; v < endVoice; ++v)
+                busy[v].store(false, std::memory_order_release);
+        }
+
+        std::atomic<int> renders[maxVoices] = {};
+        std::atomic<bool> busy[maxVoices] = {};
+        std::atomic<int> overlaps { 0 };
+        std::atomic<int> spin { 0 };
+        std::atomic<int> calls { 0 };
+    };
+}
+
+int main(int argc, char* argv[])
+{
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+    juce::ArgumentList args(argc, argv);
+
+    const int numJobs = args.containsOption("--jobs") ? args.getValueForOption("--jobs").getIntValue() : 200000;
+    const int numThreads = args.containsOption("--threads") ? args.getValueForOption("--threads").getIntValue() : VoiceRenderPool::MAXTHREADS;
+
+    VoiceRenderPool pool(maxSamples);
+    pool.setNumThreads(numThreads);
+    CountingClient client;
+    juce::Random random(1);
+    std::vector<float> out(size_t(maxSamples), 0.0f);
+
+    for (int job = 0; job < numJobs; ++job)
+    {
+        // Mostly fewer voice groups than workers, so most jobs have spare workers
+        const int numVoices = 1 + random.nextInt(job % 4 == 0 ? maxVoices : 12);
+        const int granularity = job % 2 == 0 ? 4 : 1;
+        const int numSamples = 1 + random.nextInt(maxSamples);
+
+        pool.render(client, numVoices, granularity, out.data(), numSamples);
+
+        for (int v = 0; v < maxVoices; ++v)
+        {
+            const int expected = v < numVoices ? 1 : 0;
+            const int renders = client.renders[v].exchange(0);
+            if (renders != expected)
+            {
+                std::cout << "FAIL job " << job << ": voice " << v << " of " << numVoices << " rendered " << renders << " times\n";
+                return 1;
+            }
+        }
+
+        const float expectedSum = float(numVoices * (numVoices + 1) / 2);
+        for (int i = 0; i < numSamples; ++i)
+        {
+            if (!juce::exactlyEqual(out[size_t(i)], expectedSum))
+            {
+                std::cout << "FAIL job " << job << ": sample " << i << " is " << out[size_t(i)] << ", expected " << expectedSum << "\n";
+                return 1;
+            }
+        }
+
+        if (client.overlaps.load() > 0)
+        {
+            std::cout << "FAIL job " << job << ": a voice was rendered by two threads at once\n";
+            return 1;
+        }
+    }
+
+    pool.setNumThreads(0);
+    std::cout << numJobs << " jobs on " << numThreads << " workers, every voice rendered exactly once\n";
+    return 0;
+}
@@ -0,0 +1,169 @@
+// DX10Render: renders a Standard MIDI File through DX10AudioProcessor to a
+// WAV file, without an editor or an audio device.
+//
+//   DX10Render --midi song.mid --out song.wav [--preset 15 | "Log Drum" | file.dx10]
+//              [--rate 48000] [--block 512] [--bits 24] [--tail 2.0] [--live]
+//
+// By default the render runs as a non-realtime bounce, with the offline
+// quality settings. Pass --live to render exactly like live playback, which
+// is the usual workload when profiling.
+
+#include "../../Source/JuceHeader.h"
+#include "../../Source/PluginProcessor.h"
+#include "../../Source/PresetManager.h"
+#include <iostream>
+
+namespace
+{
+    void printUsage()
+    {
+        std::cout << "usage: DX10Render --midi <file.mid> --out <file.wav> [--preset <index|name|file.dx10>]\n"
+                     "                  [--rate <Hz>] [--block <samples>] [--bits <16|24|32>] [--tail <seconds>] [--live]\n";
+    }
+
+    // Applies a factory preset by index or name, or a .dx10 preset file.
+    bool applyPreset(DX10AudioProcessor& processor, const juce::String& preset)
+    {
+        if (preset.isEmpty())
+            return true;
+
+        if (preset.endsWithIgnoreCase(PresetManager::getPresetExtension()))
+            return PresetManager::applyPresetFile(processor.apvts, juce::File::getCurrentWorkingDirectory().getChildFile(preset), false);
+
+        if (preset.containsOnly("0123456789"))
+        {
+            const int index = preset.getIntValue();
+            if (index >= processor.getNumPresets())
+                return false;
+            processor.setCurrentProgram(index);
+            return true;
+        }
+
+        for (int i = 0; i < processor.getNumPresets(); ++i)
+        {
+            if (processor.getPresetName(i).equalsIgnoreCase(preset))
+            {
+                processor.setCurrentProgram(i);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Reads every track of a MIDI file into one sequence, timed in seconds.
+    bool readMidiFile(const juce::File& file, juce::MidiMessageSequence& sequence)
+    {
+        juce::FileInputStream input(file);
+        juce::MidiFile midiFile;
+        if (!input.openedOk() || !midiFile.readFrom(input))
+            return false;
+
+        midiFile.convertTimestampTicksToSeconds();
+        for (int track = 0; track < midiFile.getNumTracks(); ++track)
+            sequence.addSequence(*midiFile.getTrack(track), 0.0);
+        sequence.sort();
+        return true;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+    juce::ArgumentList args(argc, argv);
+
+    const juce::String midiPath = args.getValueForOption("--midi");
+    const juce::String outPath = args.getValueForOption("--out");
+    if (midiPath.isEmpty() || outPath.isEmpty())
+    {
+        printUsage();
+        return 1;
+    }
+
+    const double sampleRate = args.containsOption("--rate") ? args.getValueForOption("--rate").getDoubleValue() : 48000.0;
+    const int blockSize = args.containsOption("--block") ? args.getValueForOption("--block").getIntValue() : 512;
+    const int bitsPerSample = args.containsOption("--bits") ? args.getValueForOption("--bits").getIntValue() : 24;
+    if (sampleRate < 8000.0 || blockSize < 1)
+    {
+        std::cerr << "invalid sample rate or block size\n";
+        return 1;
+    }
+
+    const juce::File midiFile = juce::File::getCurrentWorkingDirectory().getChildFile(midiPath);
+    juce::MidiMessageSequence sequence;
+    if (!readMidiFile(midiFile, sequence))
+    {
+        std::cerr << "could not read MIDI file " << midiFile.getFullPathName() << "\n";
+        return 1;
+    }
+
+    DX10AudioProcessor processor;
+    if (!applyPreset(processor, args.getValueForOption("--preset")))
+    {
+        std::cerr << "unknown preset " << args.getValueForOption("--preset") << "\n";
+        return 1;
+    }
+
+    processor.setNonRealtime(!args.containsOption("--live"));
+    processor.setPlayConfigDetails(0, 2, sampleRate, blockSize);
+    processor.prepareToPlay(sampleRate, blockSize);
+
+    // Oversampling delays the output, so that many samples are dropped from
+    // the start to line the WAV up with the MIDI file.
+    const int latency = processor.getLatencySamples();
+    const double tail = args.containsOption("--tail") ? args.getValueForOption("--tail").getDoubleValue() : processor.getTailLengthSeconds();
+    const auto lastEventTime = sequence.getNumEvents() > 0 ? sequence.getEndTime() : 0.0;
+    const auto totalSamples = juce::int64(std::ceil((lastEventTime + tail) * sampleRate));
+
+    juce::File outFile = juce::File::getCurrentWorkingDirectory().getChildFile(outPath);
+    outFile.deleteFile();
+    std::unique_ptr<juce::OutputStream> outStream = std::make_unique<juce::FileOutputStream>(outFile);
+    juce::WavAudioFormat wavFormat;
+    std::unique_ptr<juce::AudioFormatWriter> writer(wavFormat.createWriterFor(outStream.get(), sampleRate, 2, bitsPerSample, {}, 0));
+    if (writer == nullptr)
+    {
+        std::cerr << "could not write " << outFile.getFullPathName() << "\n";
+        return 1;
+    }
+    outStream.release();  // the writer owns the stream now
+
+    juce::AudioBuffer<float> buffer(2, blockSize);
+    juce::MidiBuffer midi;
+    int nextEvent = 0;
+    double renderSeconds = 0.0;
+
+    for (juce::int64 position = 0; position < totalSamples + latency; position += blockSize)
+    {
+        const int numSamples = blockSize;
+        midi.clear();
+        for (; nextEvent < sequence.getNumEvents(); ++nextEvent)
+        {
+            const auto& message = sequence.getEventPointer(nextEvent)->message;
+            const auto samplePosition = juce::int64(std::llround(message.getTimeStamp() * sampleRate));
+            if (samplePosition >= position + numSamples)
+                break;
+            if (!message.isMetaEvent() && !message.isSysEx())
+                midi.addEvent(message, juce::jmax(0, int(samplePosition - position)));
+        }
+
+        const double start = juce::Time::getMillisecondCounterHiRes();
+        processor.processBlock(buffer, midi);
+        renderSeconds += (juce::Time::getMillisecondCounterHiRes() - start) * 0.001;
+
+        // Skip the latency at the start and stop at the end of the tail
+        const int skip = int(juce::jlimit<juce::int64>(0, numSamples, latency - position));
+        const int count = int(juce::jmin<juce::int64>(numSamples - skip, totalSamples + latency - position - skip));
+        if (count > 0)
+            writer->writeFromAudioSampleBuffer(buffer, skip, count);
+    }
+
+    processor.releaseResources();
+    writer.reset();
+
+    const double audioSeconds = double(totalSamples) / sampleRate;
+    std::cout << "rendered " << juce::String(audioSeconds, 2) << " s in " << juce::String(renderSeconds, 3) << " s ("
+              << juce::String(renderSeconds > 0.0 ? audioSeconds / renderSeconds : 0.0, 1) << "x realtime)";
+    if (processor.getMidiOverflowCount() > 0)
+        std::cout << ", " << int(processor.getMidiOverflowCount()) << " MIDI events dropped";
+    std::cout << "\n";
+    return 0;
+}